@@ -3,41 +3,53 @@
 #define __ASTNODES_H__
 
 #include <llvm/IR/Value.h>
-#include <json/json.h>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 
 #include <memory>
 #include <string>
 
+#include "Arena.h"
+#include "JsonWriter.h"
+#include "Symbol.h"
+#include "Trace.h"
+
 //puts("$1"); return $1;
 using std::cout;
 using std::endl;
 using std::string;
-using std::shared_ptr;
-using std::make_shared;
 
+class ASTSimplifier;
+class ASTWriter;
 class CodeGenContext;
 class NBlock;
 class NStatement;
 class NExpression;
 class NVariableDeclaration;
 
-typedef std::vector<shared_ptr<NStatement>> StatementList;
-typedef std::vector<shared_ptr<NExpression>> ExpressionList;
-typedef std::vector<shared_ptr<NVariableDeclaration>> VariableList;
+// Nodes and their child lists are owned by the Arena of the compilation that
+// parsed them; nodes refer to each other with plain pointers.
+typedef std::vector<NStatement*, ArenaAllocator<NStatement*>> StatementList;
+typedef std::vector<NExpression*, ArenaAllocator<NExpression*>> ExpressionList;
+typedef std::vector<NVariableDeclaration*, ArenaAllocator<NVariableDeclaration*>> VariableList;
 
 class Node {
 protected:
 	const char m_DELIM = ':';
 	const char* m_PREFIX = "--";
+
+	// Never deleted through a Node*, the arena drops nodes wholesale; keeping
+	// every node trivially destructible lets it skip them at reset
+	~Node() = default;
 public:
     Node(){}
-	virtual ~Node() {}
 	virtual string getTypeName() const = 0;
 	virtual void print(string prefix) const{}
 	virtual llvm::Value *codeGen(CodeGenContext &context) { return (llvm::Value *)0; }
-	virtual Json::Value jsonGen() const { return Json::Value(); }
+	virtual void jsonGen(JsonWriter& writer) const {}
+	virtual uint32_t serialize(ASTWriter& writer) const;
+	virtual Node* simplify(ASTSimplifier& simplifier);
 };
 
 class NExpression : public Node {
@@ -52,10 +64,9 @@ public:
         cout << prefix << getTypeName() << endl;
     }
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        writer.endNode();
     }
 
 };
@@ -71,10 +82,9 @@ public:
         cout << prefix << getTypeName() << endl;
     }
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        writer.endNode();
     }
 };
 
@@ -97,13 +107,13 @@ public:
 		cout << prefix << getTypeName() << this->m_DELIM << value << endl;
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName() + this->m_DELIM + std::to_string(value);
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName(), std::to_string(value));
+        writer.endNode();
     }
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
 };
 
 class NInteger : public NExpression {
@@ -125,10 +135,9 @@ public:
         cout << prefix << getTypeName() << this->m_DELIM << value << endl;
     }
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName() + this->m_DELIM + std::to_string(value);
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName(), std::to_string(value));
+        writer.endNode();
     }
 
     operator NDouble(){
@@ -136,19 +145,23 @@ public:
     }
 
     virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
 };
 
 class NIdentifier : public NExpression {
 public:
-	std::string name;
+	Symbol name;
     bool isType = false;
     bool isArray = false;
+    bool isReference = false;       // ref parameter, passed as a pointer to the caller's struct
+    bool isConst = false;           // const ref, the callee only reads through it
+    bool isPointer = false;         // int* p, memory from new
 
-    shared_ptr<ExpressionList> arraySize = make_shared<ExpressionList>();
+    ExpressionList* arraySize = nullptr;
 
     NIdentifier(){}
 
-	NIdentifier(const std::string &name)
+	explicit NIdentifier(Symbol name)
 		: name(name) {
 		// return "NIdentifier=" << name << endl;
 	}
@@ -157,19 +170,31 @@ public:
 		return "NIdentifier";
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName() + this->m_DELIM + name + (isArray ? "(Array)" : "");
-        for(auto it=arraySize->begin(); it!=arraySize->end(); it++){
-            root["children"].append((*it)->jsonGen());
+    string decoratedName() const {
+        string text = name.str();
+        if( isReference )
+            text += isConst ? "(Const Ref)" : "(Ref)";
+        if( isPointer )
+            text += "(Pointer)";
+        if( isArray )
+            text += "(Array)";
+        return text;
+    }
+
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName(), decoratedName());
+        if( arraySize ){
+            for(auto it=arraySize->begin(); it!=arraySize->end(); it++){
+                (*it)->jsonGen(writer);
+            }
         }
-        return root;
+        writer.endNode();
     }
 
 	void print(string prefix) const override{
         string nextPrefix = prefix+this->m_PREFIX;
-		cout << prefix << getTypeName() << this->m_DELIM << name << (isArray ? "(Array)" : "") << endl;
-        if( isArray && arraySize->size() > 0 ){
+		cout << prefix << getTypeName() << this->m_DELIM << decoratedName() << endl;
+        if( isArray && arraySize && arraySize->size() > 0 ){
 //            assert(arraySize != nullptr);
             for(auto it=arraySize->begin(); it!=arraySize->end(); it++){
                 (*it)->print(nextPrefix);
@@ -178,37 +203,34 @@ public:
 	}
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
 };
 
 class NMethodCall: public NExpression {
 public:
-	const shared_ptr<NIdentifier> id;
-	shared_ptr<ExpressionList> arguments = make_shared<ExpressionList>();
+	NIdentifier* id = nullptr;
+	ExpressionList* arguments = nullptr;
 
     NMethodCall(){
 
     }
 
-	NMethodCall(const shared_ptr<NIdentifier> id, shared_ptr<ExpressionList> arguments)
+	NMethodCall(NIdentifier* id, ExpressionList* arguments)
 		: id(id), arguments(arguments) {
 	}
 
-	NMethodCall(const shared_ptr<NIdentifier> id)
-		: id(id) {
-	}
-
 	string getTypeName() const override {
 		return "NMethodCall";
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        root["children"].append(this->id->jsonGen());
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        this->id->jsonGen(writer);
         for(auto it=arguments->begin(); it!=arguments->end(); it++){
-            root["children"].append((*it)->jsonGen());
+            (*it)->jsonGen(writer);
         }
-        return root;
+        writer.endNode();
     }
 
 	void print(string prefix) const override{
@@ -221,17 +243,19 @@ public:
 	}
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
 };
 
 class NBinaryOperator : public NExpression {
 public:
 	int op;
-	shared_ptr<NExpression> lhs;
-	shared_ptr<NExpression> rhs;
+	NExpression* lhs = nullptr;
+	NExpression* rhs = nullptr;
 
     NBinaryOperator(){}
 
-    NBinaryOperator(shared_ptr<NExpression> lhs, int op, shared_ptr<NExpression> rhs)
+    NBinaryOperator(NExpression* lhs, int op, NExpression* rhs)
             : lhs(lhs), rhs(rhs), op(op) {
     }
 
@@ -239,14 +263,11 @@ public:
 		return "NBinaryOperator";
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName() + this->m_DELIM + std::to_string(op);
-
-        root["children"].append(lhs->jsonGen());
-        root["children"].append(rhs->jsonGen());
-
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName(), std::to_string(op));
+        lhs->jsonGen(writer);
+        rhs->jsonGen(writer);
+        writer.endNode();
     }
 
 	void print(string prefix) const override{
@@ -258,16 +279,51 @@ public:
 	}
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
+};
+
+class NUnaryOperator : public NExpression {
+public:
+	int op;
+	NExpression* expression = nullptr;
+
+    NUnaryOperator(){}
+
+    NUnaryOperator(int op, NExpression* expression)
+            : op(op), expression(expression) {
+    }
+
+	string getTypeName() const override {
+		return "NUnaryOperator";
+	}
+
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName(), std::to_string(op));
+        expression->jsonGen(writer);
+        writer.endNode();
+    }
+
+	void print(string prefix) const override{
+		string nextPrefix = prefix+this->m_PREFIX;
+		cout << prefix << getTypeName() << this->m_DELIM << op << endl;
+
+		expression->print(nextPrefix);
+	}
+
+	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
 };
 
 class NAssignment : public NExpression {
 public:
-	shared_ptr<NIdentifier> lhs;
-	shared_ptr<NExpression> rhs;
+	NIdentifier* lhs = nullptr;
+	NExpression* rhs = nullptr;
 
     NAssignment(){}
 
-	NAssignment(shared_ptr<NIdentifier> lhs, shared_ptr<NExpression> rhs)
+	NAssignment(NIdentifier* lhs, NExpression* rhs)
 		: lhs(lhs), rhs(rhs) {
 	}
 
@@ -282,23 +338,28 @@ public:
 		rhs->print(nextPrefix);
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        root["children"].append(lhs->jsonGen());
-        root["children"].append(rhs->jsonGen());
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        lhs->jsonGen(writer);
+        rhs->jsonGen(writer);
+        writer.endNode();
     }
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
 };
 
 class NBlock : public NExpression {
 public:
-	shared_ptr<StatementList> statements = make_shared<StatementList>();
+	StatementList* statements = nullptr;
 
     NBlock(){
 
+    }
+
+    NBlock(StatementList* statements)
+            : statements(statements) {
     }
 
 	string getTypeName() const override {
@@ -313,25 +374,26 @@ public:
 		}
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
         for(auto it=statements->begin(); it!=statements->end(); it++){
-            root["children"].append((*it)->jsonGen());
+            (*it)->jsonGen(writer);
         }
-        return root;
+        writer.endNode();
     }
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
 };
 
 class NExpressionStatement : public NStatement {
 public:
-	shared_ptr<NExpression> expression;
+	NExpression* expression = nullptr;
 
     NExpressionStatement(){}
 
-	NExpressionStatement(shared_ptr<NExpression> expression)
+	NExpressionStatement(NExpression* expression)
 		: expression(expression) {
 	}
 
@@ -345,27 +407,28 @@ public:
 		expression->print(nextPrefix);
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        root["children"].append(expression->jsonGen());
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        expression->jsonGen(writer);
+        writer.endNode();
     }
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
 };
 
 class NVariableDeclaration : public NStatement {
 public:
-	const shared_ptr<NIdentifier> type;
-	shared_ptr<NIdentifier> id;
-	shared_ptr<NExpression> assignmentExpr = nullptr;
+	NIdentifier* type = nullptr;
+	NIdentifier* id = nullptr;
+	NExpression* assignmentExpr = nullptr;
 
     NVariableDeclaration(){}
 
-	NVariableDeclaration(const shared_ptr<NIdentifier> type, shared_ptr<NIdentifier> id, shared_ptr<NExpression> assignmentExpr = NULL)
+	NVariableDeclaration(NIdentifier* type, NIdentifier* id, NExpression* assignmentExpr = nullptr)
 		: type(type), id(id), assignmentExpr(assignmentExpr) {
-            cout << "isArray = " << type->isArray << endl;
+            TRACE(Parser, 2, "isArray = " << type->isArray);
             assert(type->isType);
             assert(!type->isArray || (type->isArray && type->arraySize != nullptr));
 	}
@@ -384,31 +447,32 @@ public:
         }
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        root["children"].append(type->jsonGen());
-        root["children"].append(id->jsonGen());
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        type->jsonGen(writer);
+        id->jsonGen(writer);
         if( assignmentExpr != nullptr ){
-            root["children"].append(assignmentExpr->jsonGen());
+            assignmentExpr->jsonGen(writer);
         }
-        return root;
+        writer.endNode();
     }
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
 };
 
 class NFunctionDeclaration : public NStatement {
 public:
-	shared_ptr<NIdentifier> type;
-    shared_ptr<NIdentifier> id;
-	shared_ptr<VariableList> arguments = make_shared<VariableList>();
-	shared_ptr<NBlock> block;
+	NIdentifier* type = nullptr;
+    NIdentifier* id = nullptr;
+	VariableList* arguments = nullptr;
+	NBlock* block = nullptr;
     bool isExternal = false;
 
     NFunctionDeclaration(){}
 
-	NFunctionDeclaration(shared_ptr<NIdentifier> type, shared_ptr<NIdentifier> id, shared_ptr<VariableList> arguments, shared_ptr<NBlock> block, bool isExt = false)
+	NFunctionDeclaration(NIdentifier* type, NIdentifier* id, VariableList* arguments, NBlock* block, bool isExt = false)
 		: type(type), id(id), arguments(arguments), block(block), isExternal(isExt) {
         assert(type->isType);
 	}
@@ -433,35 +497,35 @@ public:
 		    block->print(nextPrefix);
 	}
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        root["children"].append(type->jsonGen());
-        root["children"].append(id->jsonGen());
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        type->jsonGen(writer);
+        id->jsonGen(writer);
 
         for(auto it=arguments->begin(); it!=arguments->end(); it++){
-            root["children"].append((*it)->jsonGen());
+            (*it)->jsonGen(writer);
         }
 
         assert(isExternal || block != nullptr);
         if( block ){
-            root["children"].append(block->jsonGen());
+            block->jsonGen(writer);
         }
-
-        return root;
+        writer.endNode();
     }
 
 	virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+	uint32_t serialize(ASTWriter& writer) const override;
+	Node* simplify(ASTSimplifier& simplifier) override;
 };
 
 class NStructDeclaration: public NStatement{
 public:
-    shared_ptr<NIdentifier> name;
-    shared_ptr<VariableList> members = make_shared<VariableList>();
+    NIdentifier* name = nullptr;
+    VariableList* members = nullptr;
 
     NStructDeclaration(){}
 
-    NStructDeclaration(shared_ptr<NIdentifier>  id, shared_ptr<VariableList> arguments)
+    NStructDeclaration(NIdentifier* id, VariableList* arguments)
             : name(id), members(arguments){
 
     }
@@ -480,27 +544,26 @@ public:
     }
 
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName() + this->m_DELIM + this->name->name;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName(), this->name->name.str());
 
         for(auto it=members->begin(); it!=members->end(); it++){
-            root["children"].append((*it)->jsonGen());
+            (*it)->jsonGen(writer);
         }
-
-        return root;
+        writer.endNode();
     }
 
     virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
 };
 
 class NReturnStatement: public NStatement{
 public:
-    shared_ptr<NExpression> expression;
+    NExpression* expression = nullptr;
 
     NReturnStatement(){}
 
-    NReturnStatement(shared_ptr<NExpression>  expression)
+    NReturnStatement(NExpression* expression)
             : expression(expression) {
 
     }
@@ -509,11 +572,10 @@ public:
         return "NReturnStatement";
     }
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        root["children"].append(expression->jsonGen());
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        expression->jsonGen(writer);
+        writer.endNode();
     }
 
     void print(string prefix) const override {
@@ -524,20 +586,66 @@ public:
     }
 
     virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
+
+};
+
+class NBreakStatement: public NStatement{
+public:
+    NBreakStatement(){}
+
+    string getTypeName() const override {
+        return "NBreakStatement";
+    }
+
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        writer.endNode();
+    }
+
+    void print(string prefix) const override {
+        cout << prefix << getTypeName() << this->m_DELIM << endl;
+    }
+
+    virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
+
+};
+
+class NContinueStatement: public NStatement{
+public:
+    NContinueStatement(){}
+
+    string getTypeName() const override {
+        return "NContinueStatement";
+    }
+
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        writer.endNode();
+    }
+
+    void print(string prefix) const override {
+        cout << prefix << getTypeName() << this->m_DELIM << endl;
+    }
+
+    virtual llvm::Value* codeGen(CodeGenContext& context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
 
 };
 
 class NIfStatement: public NStatement{
 public:
 
-    shared_ptr<NExpression>  condition;
-    shared_ptr<NBlock> trueBlock;          // should not be null
-    shared_ptr<NBlock> falseBlock;         // can be null
+    NExpression* condition = nullptr;
+    NBlock* trueBlock = nullptr;          // should not be null
+    NBlock* falseBlock = nullptr;         // can be null
 
 
     NIfStatement(){}
 
-    NIfStatement(shared_ptr<NExpression>  cond, shared_ptr<NBlock> blk, shared_ptr<NBlock> blk2 = nullptr)
+    NIfStatement(NExpression* cond, NBlock* blk, NBlock* blk2 = nullptr)
             : condition(cond), trueBlock(blk), falseBlock(blk2){
 
     }
@@ -560,35 +668,87 @@ public:
 
     }
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
-        root["children"].append(condition->jsonGen());
-        root["children"].append(trueBlock->jsonGen());
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        condition->jsonGen(writer);
+        trueBlock->jsonGen(writer);
         if( falseBlock ){
-            root["children"].append(falseBlock->jsonGen());
+            falseBlock->jsonGen(writer);
         }
-        return root;
+        writer.endNode();
     }
 
 
     llvm::Value *codeGen(CodeGenContext &context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
 
 
 };
 
+// Annotations written before a for or while, e.g.
+//   @vectorize(4) @unroll(8) @interleave(2) @no_alias for(...)
+// handed to LLVM's loop passes as llvm.loop metadata on the back edge.
+// A count of 0 leaves the choice to the pass. @no_alias promises that
+// iterations do not touch each other's memory.
+struct LoopHints{
+    bool vectorize = false;
+    uint32_t vectorizeWidth = 0;
+    bool unroll = false;
+    uint32_t unrollCount = 0;
+    uint32_t interleaveCount = 0;
+    bool noAlias = false;
+
+    // Apply @name or @name(value), false for an unknown hint or a bad value
+    bool set(const string& name, bool hasValue, uint64_t value){
+        if( hasValue && (value == 0 || value > UINT32_MAX) )
+            return false;
+        if( name == "vectorize" ){
+            vectorize = true;
+            vectorizeWidth = (uint32_t)value;
+        }else if( name == "unroll" ){
+            unroll = true;
+            unrollCount = (uint32_t)value;
+        }else if( name == "interleave" && hasValue ){
+            interleaveCount = (uint32_t)value;
+        }else if( name == "no_alias" && !hasValue ){
+            noAlias = true;
+        }else{
+            return false;
+        }
+        return true;
+    }
+
+    bool empty() const{
+        return !vectorize && !unroll && interleaveCount == 0 && !noAlias;
+    }
+
+    string str() const{
+        string text;
+        auto append = [&text](const string& hint, uint32_t value){
+            text += (text.empty() ? "@" : " @") + hint;
+            if( value )
+                text += "(" + std::to_string(value) + ")";
+        };
+        if( vectorize ) append("vectorize", vectorizeWidth);
+        if( unroll ) append("unroll", unrollCount);
+        if( interleaveCount ) append("interleave", interleaveCount);
+        if( noAlias ) append("no_alias", 0);
+        return text;
+    }
+};
+
 class NForStatement: public NStatement{
 public:
-    shared_ptr<NExpression> initial, condition, increment;
-    shared_ptr<NBlock>  block;
+    NExpression *initial = nullptr, *condition = nullptr, *increment = nullptr;
+    NBlock* block = nullptr;
+    LoopHints hints;
 
     NForStatement(){}
 
-    NForStatement(shared_ptr<NBlock> b, shared_ptr<NExpression> init = nullptr, shared_ptr<NExpression> cond = nullptr, shared_ptr<NExpression> incre = nullptr)
+    NForStatement(NBlock* b, NExpression* init = nullptr, NExpression* cond = nullptr, NExpression* incre = nullptr)
             : block(b), initial(init), condition(cond), increment(incre){
-        if( condition == nullptr ){
-            condition = make_shared<NInteger>(1);
-        }
+        assert(condition != nullptr);
     }
 
     string getTypeName() const override{
@@ -598,7 +758,7 @@ public:
     void print(string prefix) const override{
 
         string nextPrefix = prefix + this->m_PREFIX;
-        cout << prefix << getTypeName() << this->m_DELIM << endl;
+        cout << prefix << getTypeName() << this->m_DELIM << hints.str() << endl;
 
         if( initial )
             initial->print(nextPrefix);
@@ -611,32 +771,33 @@ public:
     }
 
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName(), hints.str());
 
         if( initial )
-            root["children"].append(initial->jsonGen());
+            initial->jsonGen(writer);
         if( condition )
-            root["children"].append(condition->jsonGen());
+            condition->jsonGen(writer);
         if( increment )
-            root["children"].append(increment->jsonGen());
+            increment->jsonGen(writer);
 
-        return root;
+        writer.endNode();
     }
 
     llvm::Value *codeGen(CodeGenContext &context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
 
 };
 
 class NStructMember: public NExpression{
 public:
-	shared_ptr<NIdentifier> id;
-	shared_ptr<NIdentifier> member;
+	NIdentifier* id = nullptr;
+	NIdentifier* member = nullptr;
 
     NStructMember(){}
     
-    NStructMember(shared_ptr<NIdentifier> structName, shared_ptr<NIdentifier>member)
+    NStructMember(NIdentifier* structName, NIdentifier* member)
             : id(structName),member(member) {
     }
 
@@ -654,35 +815,29 @@ public:
     }
 
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
 
-        root["children"].append(id->jsonGen());
-        root["children"].append(member->jsonGen());
+        id->jsonGen(writer);
+        member->jsonGen(writer);
 
-        return root;
+        writer.endNode();
     }
 
     llvm::Value *codeGen(CodeGenContext &context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
 
 };
 
 class NArrayIndex: public NExpression{
 public:
-    shared_ptr<NIdentifier>  arrayName;
-//    shared_ptr<NExpression>  expression;
-    shared_ptr<ExpressionList> expressions = make_shared<ExpressionList>();
+    NIdentifier* arrayName = nullptr;
+//    NExpression* expression;
+    ExpressionList* expressions = nullptr;
 
     NArrayIndex(){}
 
-    NArrayIndex(shared_ptr<NIdentifier>  name, shared_ptr<NExpression>  exp)
-            : arrayName(name){
-        expressions->push_back(exp);
-    }
-
-
-    NArrayIndex(shared_ptr<NIdentifier>  name, shared_ptr<ExpressionList> list)
+    NArrayIndex(NIdentifier* name, ExpressionList* list)
             : arrayName(name), expressions(list){
     }
 
@@ -701,30 +856,30 @@ public:
 //        expression->print(nextPrefix);
     }
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
 
-        root["children"].append(arrayName->jsonGen());
-//        root["children"].append(expression->jsonGen());
+        arrayName->jsonGen(writer);
         for(auto it=expressions->begin(); it!=expressions->end(); it++){
-            root["children"].append((*it)->jsonGen());
+            (*it)->jsonGen(writer);
         }
-        return root;
+        writer.endNode();
     }
 
     llvm::Value *codeGen(CodeGenContext &context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
 
 };
 
 class NArrayAssignment: public NExpression{
 public:
-    shared_ptr<NArrayIndex> arrayIndex;
-    shared_ptr<NExpression>  expression;
+    NArrayIndex* arrayIndex = nullptr;
+    NExpression* expression = nullptr;
 
     NArrayAssignment(){}
 
-    NArrayAssignment(shared_ptr<NArrayIndex> index, shared_ptr<NExpression>  exp)
+    NArrayAssignment(NArrayIndex* index, NExpression* exp)
             : arrayIndex(index), expression(exp){
 
     }
@@ -743,18 +898,19 @@ public:
     }
 
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
 
-        root["children"].append(arrayIndex->jsonGen());
-        root["children"].append(expression->jsonGen());
+        arrayIndex->jsonGen(writer);
+        expression->jsonGen(writer);
 
-        return root;
+        writer.endNode();
     }
 
 
     llvm::Value *codeGen(CodeGenContext &context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
 
 };
 
@@ -763,10 +919,10 @@ public:
 
     NArrayInitialization(){}
 
-    shared_ptr<NVariableDeclaration> declaration;
-    shared_ptr<ExpressionList> expressionList = make_shared<ExpressionList>();
+    NVariableDeclaration* declaration = nullptr;
+    ExpressionList* expressionList = nullptr;
 
-    NArrayInitialization(shared_ptr<NVariableDeclaration> dec, shared_ptr<ExpressionList> list)
+    NArrayInitialization(NVariableDeclaration* dec, ExpressionList* list)
             : declaration(dec), expressionList(list){
 
     }
@@ -787,30 +943,31 @@ public:
     }
 
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
 
-        root["children"].append(declaration->jsonGen());
+        declaration->jsonGen(writer);
         for(auto it=expressionList->begin(); it!=expressionList->end(); it++)
-            root["children"].append((*it)->jsonGen());
+            (*it)->jsonGen(writer);
 
-        return root;
+        writer.endNode();
     }
 
 
     llvm::Value *codeGen(CodeGenContext &context) override ;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
 
 };
 
 class NStructAssignment: public NExpression{
 public:
-    shared_ptr<NStructMember> structMember;
-    shared_ptr<NExpression>  expression;
+    NStructMember* structMember = nullptr;
+    NExpression* expression = nullptr;
 
     NStructAssignment(){}
 
-    NStructAssignment(shared_ptr<NStructMember> member, shared_ptr<NExpression>  exp)
+    NStructAssignment(NStructMember* member, NExpression* exp)
             : structMember(member), expression(exp){
 
     }
@@ -829,28 +986,29 @@ public:
     }
 
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName();
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
 
-        root["children"].append(structMember->jsonGen());
-        root["children"].append(expression->jsonGen());
+        structMember->jsonGen(writer);
+        expression->jsonGen(writer);
 
-        return root;
+        writer.endNode();
     }
 
     llvm::Value *codeGen(CodeGenContext &context) override;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
 
 };
 
 class NLiteral: public NExpression{
 public:
-    string value;
+    Symbol value;       // interned without the surrounding quotes
 
     NLiteral(){}
 
-    NLiteral(const string &str) {
-        value = str.substr(1, str.length()-2);
+    NLiteral(Symbol value)
+            : value(value) {
     }
 
     string getTypeName() const override{
@@ -864,14 +1022,85 @@ public:
     }
 
 
-    Json::Value jsonGen() const override {
-        Json::Value root;
-        root["name"] = getTypeName() + this->m_DELIM + value;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName(), value.str());
+        writer.endNode();
+    }
+
+    llvm::Value *codeGen(CodeGenContext &context) override;
+    uint32_t serialize(ASTWriter& writer) const override;
+
+};
+
+// new int[n] and new struct Point: memory from the runtime arena, see TinyRuntime.h
+class NNewExpression: public NExpression{
+public:
+    NIdentifier* type = nullptr;        // element type
+    NExpression* count = nullptr;       // nullptr allocates a single element
+
+    NNewExpression(){}
+
+    NNewExpression(NIdentifier* type, NExpression* count)
+            : type(type), count(count) {
+    }
+
+    string getTypeName() const override{
+        return "NNewExpression";
+    }
+
+    void print(string prefix) const override{
+        string nextPrefix = prefix + this->m_PREFIX;
+        cout << prefix << getTypeName() << this->m_DELIM << endl;
+
+        type->print(nextPrefix);
+        if( count )
+            count->print(nextPrefix);
+    }
+
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        type->jsonGen(writer);
+        if( count )
+            count->jsonGen(writer);
+        writer.endNode();
+    }
+
+    llvm::Value *codeGen(CodeGenContext &context) override;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
+
+};
+
+class NDeleteStatement: public NStatement{
+public:
+    NExpression* expression = nullptr;
+
+    NDeleteStatement(){}
+
+    NDeleteStatement(NExpression* expression)
+            : expression(expression) {
+    }
+
+    string getTypeName() const override{
+        return "NDeleteStatement";
+    }
+
+    void print(string prefix) const override{
+        string nextPrefix = prefix + this->m_PREFIX;
+        cout << prefix << getTypeName() << this->m_DELIM << endl;
+
+        expression->print(nextPrefix);
+    }
 
-        return root;
+    void jsonGen(JsonWriter& writer) const override {
+        writer.beginNode(getTypeName());
+        expression->jsonGen(writer);
+        writer.endNode();
     }
 
     llvm::Value *codeGen(CodeGenContext &context) override;
+    uint32_t serialize(ASTWriter& writer) const override;
+    Node* simplify(ASTSimplifier& simplifier) override;
 
 };
 
@@ -0,0 +1,800 @@
+//
+// Versioned binary form of the AST, written after parsing and loaded back
+// instead of running the scanner and parser again.
+//
+
+#include <cstddef>
+#include <cstdio>
+#include <type_traits>
+#include <utility>
+
+#include "ASTSerializer.h"
+#include "ParseContext.h"
+#include "SourceBuffer.h"
+#include "TimeTrace.h"
+#include "grammar.hpp"
+
+#define AST_KINDS(X) \
+    X(Double, NDouble) \
+    X(Integer, NInteger) \
+    X(Identifier, NIdentifier) \
+    X(MethodCall, NMethodCall) \
+    X(BinaryOperator, NBinaryOperator) \
+    X(Assignment, NAssignment) \
+    X(Block, NBlock) \
+    X(ExpressionStatement, NExpressionStatement) \
+    X(VariableDeclaration, NVariableDeclaration) \
+    X(FunctionDeclaration, NFunctionDeclaration) \
+    X(StructDeclaration, NStructDeclaration) \
+    X(ReturnStatement, NReturnStatement) \
+    X(IfStatement, NIfStatement) \
+    X(ForStatement, NForStatement) \
+    X(StructMember, NStructMember) \
+    X(ArrayIndex, NArrayIndex) \
+    X(ArrayAssignment, NArrayAssignment) \
+    X(ArrayInitialization, NArrayInitialization) \
+    X(StructAssignment, NStructAssignment) \
+    X(Literal, NLiteral) \
+    X(UnaryOperator, NUnaryOperator) \
+    X(BreakStatement, NBreakStatement) \
+    X(ContinueStatement, NContinueStatement) \
+    X(NewExpression, NNewExpression) \
+    X(DeleteStatement, NDeleteStatement)
+
+static const uint32_t byteOrderMark = 0x01020304;
+
+// Token numbers move whenever grammar.y changes, so operators are stored as
+// their index in this table. Only ever append to it.
+static const int binaryOperators[] = {
+    TCEQ, TCNE, TCLT, TCLE, TCGT, TCGE,
+    TAND, TOR, TXOR, TSHIFTL, TSHIFTR,
+    TMOD, TMUL, TDIV, TPLUS, TMINUS,
+    TLAND, TLOR,
+};
+
+static const uint32_t binaryOperatorCount = sizeof(binaryOperators) / sizeof(binaryOperators[0]);
+
+static const int unaryOperators[] = {
+    TNOT,
+};
+
+static const uint32_t unaryOperatorCount = sizeof(unaryOperators) / sizeof(unaryOperators[0]);
+
+static uint32_t encodeOperator(const int* table, uint32_t count, int op){
+    for(uint32_t i=0; i<count; i++){
+        if( table[i] == op )
+            return i;
+    }
+    return ASTWriter::nullOffset;
+}
+
+// Storage a node takes in the reader's slab, rounded so the next one stays aligned
+template<typename T>
+static size_t slabSize(){
+    static const size_t alignment = alignof(std::max_align_t);
+    return (sizeof(T) + alignment - 1) / alignment * alignment;
+}
+
+static size_t nodeSize(ASTKind kind){
+    switch( kind ){
+#define NODE_SIZE(kind, type) case ASTKind::kind: return slabSize<type>();
+        AST_KINDS(NODE_SIZE)
+#undef NODE_SIZE
+        default: return 0;
+    }
+}
+
+static size_t padding(size_t size){
+    return (4 - size % 4) % 4;
+}
+
+/*
+ * ASTWriter
+ */
+
+uint32_t ASTWriter::node(const Node *node) {
+    if( !node )
+        return nullOffset;
+    auto written = _written.find(node);
+    if( written != _written.end() )
+        return written->second;
+
+    uint32_t offset = node->serialize(*this);
+    _written[node] = offset;
+    return offset;
+}
+
+uint32_t ASTWriter::begin(ASTKind kind) {
+    if( _nodes.size() >= nullOffset ){
+        _failed = true;
+        return nullOffset;
+    }
+    uint32_t offset = (uint32_t)_nodes.size();
+    _kindCounts[(size_t)kind]++;
+    u32((uint32_t)kind);
+    return offset;
+}
+
+void ASTWriter::symbol(Symbol symbol) {
+    auto index = _stringIndex.find(symbol.id());
+    if( index != _stringIndex.end() ){
+        u32(index->second);
+        return;
+    }
+    uint32_t next = (uint32_t)_strings.size();
+    _stringIndex[symbol.id()] = next;
+    _strings.push_back(symbol);
+    u32(next);
+}
+
+uint32_t ASTWriter::unsupported(const Node &node) {
+    fprintf(stderr, "Can't serialize %s\n", node.getTypeName().c_str());
+    _failed = true;
+    return nullOffset;
+}
+
+bool ASTWriter::write(const NBlock &program, const std::string &path) {
+    TraceScope timeScope("Write AST", path);
+    uint32_t root = node(&program);
+    if( _failed )
+        return false;
+
+    std::string strings;
+    for(auto& symbol: _strings){
+        uint32_t length = (uint32_t)symbol.str().size();
+        strings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        strings.append(symbol.str());
+        strings.append(padding(length), '\0');
+    }
+
+    ASTFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TINYCOMPILER_AST_MAGIC, sizeof(header.magic));
+    header.version = TINYCOMPILER_AST_VERSION;
+    header.byteOrder = byteOrderMark;
+    header.stringCount = (uint32_t)_strings.size();
+    header.stringsOffset = sizeof(header);
+    header.nodesOffset = (uint32_t)(sizeof(header) + strings.size());
+    header.nodesSize = (uint32_t)_nodes.size();
+    header.root = root;
+    memcpy(header.kindCounts, _kindCounts, sizeof(header.kindCounts));
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if( !file ){
+        fprintf(stderr, "Can't open %s\n", path.c_str());
+        return false;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1
+                   && fwrite(strings.data(), 1, strings.size(), file) == strings.size()
+                   && fwrite(_nodes.data(), 1, _nodes.size(), file) == _nodes.size();
+    success = fclose(file) == 0 && success;
+    if( !success )
+        fprintf(stderr, "Failed to write %s\n", path.c_str());
+    return success;
+}
+
+/*
+ * Records, one per node type. Children are written first so that their
+ * offsets are known when the record itself is written.
+ */
+
+uint32_t Node::serialize(ASTWriter &writer) const {
+    return writer.unsupported(*this);
+}
+
+uint32_t NDouble::serialize(ASTWriter &writer) const {
+    uint32_t offset = writer.begin(ASTKind::Double);
+    writer.f64(value);
+    return offset;
+}
+
+uint32_t NInteger::serialize(ASTWriter &writer) const {
+    uint32_t offset = writer.begin(ASTKind::Integer);
+    writer.u64(value);
+    return offset;
+}
+
+uint32_t NIdentifier::serialize(ASTWriter &writer) const {
+    auto sizes = writer.list(arraySize);
+    uint32_t offset = writer.begin(ASTKind::Identifier);
+    writer.symbol(name);
+    writer.u32((isType ? 1 : 0) | (isArray ? 2 : 0) | (isReference ? 4 : 0) | (isConst ? 8 : 0)
+               | (isPointer ? 16 : 0));
+    writer.offsets(sizes, arraySize != nullptr);
+    return offset;
+}
+
+uint32_t NMethodCall::serialize(ASTWriter &writer) const {
+    uint32_t callee = writer.node(id);
+    auto args = writer.list(arguments);
+    uint32_t offset = writer.begin(ASTKind::MethodCall);
+    writer.u32(callee);
+    writer.offsets(args, arguments != nullptr);
+    return offset;
+}
+
+uint32_t NBinaryOperator::serialize(ASTWriter &writer) const {
+    uint32_t left = writer.node(lhs);
+    uint32_t right = writer.node(rhs);
+    uint32_t offset = writer.begin(ASTKind::BinaryOperator);
+    writer.u32(encodeOperator(binaryOperators, binaryOperatorCount, op));
+    writer.u32(left);
+    writer.u32(right);
+    return offset;
+}
+
+uint32_t NUnaryOperator::serialize(ASTWriter &writer) const {
+    uint32_t operand = writer.node(expression);
+    uint32_t offset = writer.begin(ASTKind::UnaryOperator);
+    writer.u32(encodeOperator(unaryOperators, unaryOperatorCount, op));
+    writer.u32(operand);
+    return offset;
+}
+
+uint32_t NAssignment::serialize(ASTWriter &writer) const {
+    uint32_t left = writer.node(lhs);
+    uint32_t right = writer.node(rhs);
+    uint32_t offset = writer.begin(ASTKind::Assignment);
+    writer.u32(left);
+    writer.u32(right);
+    return offset;
+}
+
+uint32_t NBlock::serialize(ASTWriter &writer) const {
+    auto children = writer.list(statements);
+    uint32_t offset = writer.begin(ASTKind::Block);
+    writer.offsets(children, statements != nullptr);
+    return offset;
+}
+
+uint32_t NExpressionStatement::serialize(ASTWriter &writer) const {
+    uint32_t child = writer.node(expression);
+    uint32_t offset = writer.begin(ASTKind::ExpressionStatement);
+    writer.u32(child);
+    return offset;
+}
+
+uint32_t NVariableDeclaration::serialize(ASTWriter &writer) const {
+    uint32_t typeOffset = writer.node(type);
+    uint32_t idOffset = writer.node(id);
+    uint32_t initial = writer.node(assignmentExpr);
+    uint32_t offset = writer.begin(ASTKind::VariableDeclaration);
+    writer.u32(typeOffset);
+    writer.u32(idOffset);
+    writer.u32(initial);
+    return offset;
+}
+
+uint32_t NFunctionDeclaration::serialize(ASTWriter &writer) const {
+    uint32_t typeOffset = writer.node(type);
+    uint32_t idOffset = writer.node(id);
+    auto args = writer.list(arguments);
+    uint32_t body = writer.node(block);
+    uint32_t offset = writer.begin(ASTKind::FunctionDeclaration);
+    writer.u32(typeOffset);
+    writer.u32(idOffset);
+    writer.offsets(args, arguments != nullptr);
+    writer.u32(body);
+    writer.u32(isExternal ? 1 : 0);
+    return offset;
+}
+
+uint32_t NStructDeclaration::serialize(ASTWriter &writer) const {
+    uint32_t nameOffset = writer.node(name);
+    auto fields = writer.list(members);
+    uint32_t offset = writer.begin(ASTKind::StructDeclaration);
+    writer.u32(nameOffset);
+    writer.offsets(fields, members != nullptr);
+    return offset;
+}
+
+uint32_t NReturnStatement::serialize(ASTWriter &writer) const {
+    uint32_t child = writer.node(expression);
+    uint32_t offset = writer.begin(ASTKind::ReturnStatement);
+    writer.u32(child);
+    return offset;
+}
+
+uint32_t NIfStatement::serialize(ASTWriter &writer) const {
+    uint32_t cond = writer.node(condition);
+    uint32_t thenBlock = writer.node(trueBlock);
+    uint32_t elseBlock = writer.node(falseBlock);
+    uint32_t offset = writer.begin(ASTKind::IfStatement);
+    writer.u32(cond);
+    writer.u32(thenBlock);
+    writer.u32(elseBlock);
+    return offset;
+}
+
+uint32_t NForStatement::serialize(ASTWriter &writer) const {
+    uint32_t init = writer.node(initial);
+    uint32_t cond = writer.node(condition);
+    uint32_t incre = writer.node(increment);
+    uint32_t body = writer.node(block);
+    uint32_t offset = writer.begin(ASTKind::ForStatement);
+    writer.u32(init);
+    writer.u32(cond);
+    writer.u32(incre);
+    writer.u32(body);
+    writer.u32(hints.vectorize);
+    writer.u32(hints.vectorizeWidth);
+    writer.u32(hints.unroll);
+    writer.u32(hints.unrollCount);
+    writer.u32(hints.interleaveCount);
+    writer.u32(hints.noAlias);
+    return offset;
+}
+
+uint32_t NStructMember::serialize(ASTWriter &writer) const {
+    uint32_t structOffset = writer.node(id);
+    uint32_t memberOffset = writer.node(member);
+    uint32_t offset = writer.begin(ASTKind::StructMember);
+    writer.u32(structOffset);
+    writer.u32(memberOffset);
+    return offset;
+}
+
+uint32_t NArrayIndex::serialize(ASTWriter &writer) const {
+    uint32_t nameOffset = writer.node(arrayName);
+    auto indices = writer.list(expressions);
+    uint32_t offset = writer.begin(ASTKind::ArrayIndex);
+    writer.u32(nameOffset);
+    writer.offsets(indices, expressions != nullptr);
+    return offset;
+}
+
+uint32_t NArrayAssignment::serialize(ASTWriter &writer) const {
+    uint32_t index = writer.node(arrayIndex);
+    uint32_t value = writer.node(expression);
+    uint32_t offset = writer.begin(ASTKind::ArrayAssignment);
+    writer.u32(index);
+    writer.u32(value);
+    return offset;
+}
+
+uint32_t NArrayInitialization::serialize(ASTWriter &writer) const {
+    uint32_t decl = writer.node(declaration);
+    auto values = writer.list(expressionList);
+    uint32_t offset = writer.begin(ASTKind::ArrayInitialization);
+    writer.u32(decl);
+    writer.offsets(values, expressionList != nullptr);
+    return offset;
+}
+
+uint32_t NStructAssignment::serialize(ASTWriter &writer) const {
+    uint32_t member = writer.node(structMember);
+    uint32_t value = writer.node(expression);
+    uint32_t offset = writer.begin(ASTKind::StructAssignment);
+    writer.u32(member);
+    writer.u32(value);
+    return offset;
+}
+
+uint32_t NLiteral::serialize(ASTWriter &writer) const {
+    uint32_t offset = writer.begin(ASTKind::Literal);
+    writer.symbol(value);
+    return offset;
+}
+
+uint32_t NBreakStatement::serialize(ASTWriter &writer) const {
+    return writer.begin(ASTKind::BreakStatement);
+}
+
+uint32_t NContinueStatement::serialize(ASTWriter &writer) const {
+    return writer.begin(ASTKind::ContinueStatement);
+}
+
+uint32_t NNewExpression::serialize(ASTWriter &writer) const {
+    uint32_t typeOffset = writer.node(type);
+    uint32_t countOffset = writer.node(count);
+    uint32_t offset = writer.begin(ASTKind::NewExpression);
+    writer.u32(typeOffset);
+    writer.u32(countOffset);
+    return offset;
+}
+
+uint32_t NDeleteStatement::serialize(ASTWriter &writer) const {
+    uint32_t pointer = writer.node(expression);
+    uint32_t offset = writer.begin(ASTKind::DeleteStatement);
+    writer.u32(pointer);
+    return offset;
+}
+
+/*
+ * ASTReader
+ */
+
+bool ASTReader::fail(const char *message) {
+    if( !_failed )
+        fprintf(stderr, "Corrupt AST file %s: %s\n", _path.c_str(), message);
+    _failed = true;
+    return false;
+}
+
+template<typename T, typename... Args>
+T* ASTReader::make(Args&&... args) {
+    // the slab holds a whole file's nodes, none of them may need a destructor
+    static_assert(std::is_trivially_destructible<T>::value, "AST nodes must stay trivially destructible");
+    size_t size = slabSize<T>();
+    if( size > _slabLeft ){
+        fail("more nodes than the header declares");
+        return nullptr;
+    }
+    T* node = _context.arena.construct<T>(_slab, std::forward<Args>(args)...);
+    _slab += size;
+    _slabLeft -= size;
+    return node;
+}
+
+template<typename T>
+T* ASTReader::child(uint32_t offset, uint32_t parent, bool required) {
+    if( _failed )
+        return nullptr;
+    if( offset == ASTWriter::nullOffset ){
+        if( required )
+            fail("missing child");
+        return nullptr;
+    }
+    if( offset >= parent ){
+        fail("child does not precede its parent");
+        return nullptr;
+    }
+    T* node = dynamic_cast<T*>(build(offset));
+    if( !node )
+        fail("child of the wrong kind");
+    return node;
+}
+
+uint32_t ASTReader::Record::u32() {
+    uint32_t value = 0;
+    if( position + sizeof(value) > reader._nodesSize ){
+        reader.fail("record runs past the end of the file");
+        return ASTWriter::nullOffset;
+    }
+    memcpy(&value, reader._nodes + position, sizeof(value));
+    position += sizeof(value);
+    return value;
+}
+
+uint64_t ASTReader::Record::u64() {
+    uint64_t value = 0;
+    if( position + sizeof(value) > reader._nodesSize ){
+        reader.fail("record runs past the end of the file");
+        return 0;
+    }
+    memcpy(&value, reader._nodes + position, sizeof(value));
+    position += sizeof(value);
+    return value;
+}
+
+double ASTReader::Record::f64() {
+    double value = 0;
+    if( position + sizeof(value) > reader._nodesSize ){
+        reader.fail("record runs past the end of the file");
+        return 0;
+    }
+    memcpy(&value, reader._nodes + position, sizeof(value));
+    position += sizeof(value);
+    return value;
+}
+
+Symbol ASTReader::Record::symbol() {
+    uint32_t index = u32();
+    if( index >= reader._strings.size() ){
+        reader.fail("string index out of range");
+        return Symbol();
+    }
+    return reader._strings[index];
+}
+
+template<typename List>
+List* ASTReader::Record::list(bool required) {
+    typedef typename std::remove_pointer<typename List::value_type>::type Element;
+
+    uint32_t count = u32();
+    if( count == ASTWriter::nullOffset ){
+        if( required )
+            reader.fail("missing child list");
+        return nullptr;
+    }
+    if( count > (reader._nodesSize - position) / sizeof(uint32_t) ){
+        reader.fail("child list runs past the end of the file");
+        return nullptr;
+    }
+
+    // the parser leaves holes for unsupported expressions (unary minus), keep them
+    bool elementsRequired = !std::is_same<List, ExpressionList>::value;
+    List* list = reader._context.arena.makeList<List>();
+    list->reserve(count);
+    for(uint32_t i=0; i<count && !reader._failed; i++){
+        list->push_back(child<Element>(elementsRequired));
+    }
+    return list;
+}
+
+Node* ASTReader::build(uint32_t offset) {
+    auto built = _built.find(offset);
+    if( built != _built.end() )
+        return built->second;
+    if( offset % 4 != 0 ){
+        fail("misaligned record");
+        return nullptr;
+    }
+
+    Record record{*this, offset, offset};
+    ASTKind kind = (ASTKind)record.u32();
+    Node* node = nullptr;
+
+    switch( kind ){
+        case ASTKind::Double: {
+            double value = record.f64();
+            node = make<NDouble>(value);
+            break;
+        }
+        case ASTKind::Integer: {
+            uint64_t value = record.u64();
+            node = make<NInteger>(value);
+            break;
+        }
+        case ASTKind::Identifier: {
+            Symbol name = record.symbol();
+            uint32_t flags = record.u32();
+            auto sizes = record.list<ExpressionList>(false);
+            if( (flags & 2) && !sizes )
+                fail("array type without sizes");
+            if( _failed )
+                return nullptr;
+            auto identifier = make<NIdentifier>(name);
+            if( identifier ){
+                identifier->isType = (flags & 1) != 0;
+                identifier->isArray = (flags & 2) != 0;
+                identifier->isReference = (flags & 4) != 0;
+                identifier->isConst = (flags & 8) != 0;
+                identifier->isPointer = (flags & 16) != 0;
+                identifier->arraySize = sizes;
+            }
+            node = identifier;
+            break;
+        }
+        case ASTKind::MethodCall: {
+            auto id = record.child<NIdentifier>();
+            auto args = record.list<ExpressionList>();
+            if( !_failed )
+                node = make<NMethodCall>(id, args);
+            break;
+        }
+        case ASTKind::BinaryOperator: {
+            uint32_t op = record.u32();
+            auto lhs = record.child<NExpression>(false);
+            auto rhs = record.child<NExpression>(false);
+            if( op >= binaryOperatorCount )
+                fail("unknown operator");
+            if( !_failed )
+                node = make<NBinaryOperator>(lhs, binaryOperators[op], rhs);
+            break;
+        }
+        case ASTKind::UnaryOperator: {
+            uint32_t op = record.u32();
+            auto expression = record.child<NExpression>();
+            if( op >= unaryOperatorCount )
+                fail("unknown operator");
+            if( !_failed )
+                node = make<NUnaryOperator>(unaryOperators[op], expression);
+            break;
+        }
+        case ASTKind::Assignment: {
+            auto lhs = record.child<NIdentifier>();
+            auto rhs = record.child<NExpression>(false);
+            if( !_failed )
+                node = make<NAssignment>(lhs, rhs);
+            break;
+        }
+        case ASTKind::Block: {
+            auto statements = record.list<StatementList>();
+            if( !_failed )
+                node = make<NBlock>(statements);
+            break;
+        }
+        case ASTKind::ExpressionStatement: {
+            auto expression = record.child<NExpression>(false);
+            if( !_failed )
+                node = make<NExpressionStatement>(expression);
+            break;
+        }
+        case ASTKind::VariableDeclaration: {
+            auto type = record.child<NIdentifier>();
+            auto id = record.child<NIdentifier>();
+            auto initial = record.child<NExpression>(false);
+            if( !_failed && !type->isType )
+                fail("variable type is not a type");
+            if( !_failed )
+                node = make<NVariableDeclaration>(type, id, initial);
+            break;
+        }
+        case ASTKind::FunctionDeclaration: {
+            auto type = record.child<NIdentifier>();
+            auto id = record.child<NIdentifier>();
+            auto args = record.list<VariableList>();
+            auto block = record.child<NBlock>(false);
+            bool isExternal = record.u32() != 0;
+            if( !_failed && (!type->isType || (!isExternal && !block)) )
+                fail("malformed function declaration");
+            if( !_failed )
+                node = make<NFunctionDeclaration>(type, id, args, block, isExternal);
+            break;
+        }
+        case ASTKind::StructDeclaration: {
+            auto name = record.child<NIdentifier>();
+            auto members = record.list<VariableList>();
+            if( !_failed )
+                node = make<NStructDeclaration>(name, members);
+            break;
+        }
+        case ASTKind::ReturnStatement: {
+            auto expression = record.child<NExpression>(false);
+            if( !_failed )
+                node = make<NReturnStatement>(expression);
+            break;
+        }
+        case ASTKind::IfStatement: {
+            auto condition = record.child<NExpression>(false);
+            auto trueBlock = record.child<NBlock>();
+            auto falseBlock = record.child<NBlock>(false);
+            if( !_failed )
+                node = make<NIfStatement>(condition, trueBlock, falseBlock);
+            break;
+        }
+        case ASTKind::ForStatement: {
+            auto initial = record.child<NExpression>(false);
+            auto condition = record.child<NExpression>();
+            auto increment = record.child<NExpression>(false);
+            auto block = record.child<NBlock>();
+            LoopHints hints;
+            hints.vectorize = record.u32() != 0;
+            hints.vectorizeWidth = record.u32();
+            hints.unroll = record.u32() != 0;
+            hints.unrollCount = record.u32();
+            hints.interleaveCount = record.u32();
+            hints.noAlias = record.u32() != 0;
+            if( !_failed ){
+                auto loop = make<NForStatement>(block, initial, condition, increment);
+                if( loop )
+                    loop->hints = hints;
+                node = loop;
+            }
+            break;
+        }
+        case ASTKind::StructMember: {
+            auto id = record.child<NIdentifier>();
+            auto member = record.child<NIdentifier>();
+            if( !_failed )
+                node = make<NStructMember>(id, member);
+            break;
+        }
+        case ASTKind::ArrayIndex: {
+            auto name = record.child<NIdentifier>();
+            auto indices = record.list<ExpressionList>();
+            if( !_failed )
+                node = make<NArrayIndex>(name, indices);
+            break;
+        }
+        case ASTKind::ArrayAssignment: {
+            auto index = record.child<NArrayIndex>();
+            auto expression = record.child<NExpression>(false);
+            if( !_failed )
+                node = make<NArrayAssignment>(index, expression);
+            break;
+        }
+        case ASTKind::ArrayInitialization: {
+            auto declaration = record.child<NVariableDeclaration>();
+            auto values = record.list<ExpressionList>();
+            if( !_failed )
+                node = make<NArrayInitialization>(declaration, values);
+            break;
+        }
+        case ASTKind::StructAssignment: {
+            auto member = record.child<NStructMember>();
+            auto expression = record.child<NExpression>(false);
+            if( !_failed )
+                node = make<NStructAssignment>(member, expression);
+            break;
+        }
+        case ASTKind::Literal: {
+            Symbol value = record.symbol();
+            if( !_failed )
+                node = make<NLiteral>(value);
+            break;
+        }
+        case ASTKind::BreakStatement:
+            node = make<NBreakStatement>();
+            break;
+        case ASTKind::ContinueStatement:
+            node = make<NContinueStatement>();
+            break;
+        case ASTKind::NewExpression: {
+            auto type = record.child<NIdentifier>();
+            auto count = record.child<NExpression>(false);
+            if( !_failed )
+                node = make<NNewExpression>(type, count);
+            break;
+        }
+        case ASTKind::DeleteStatement: {
+            auto expression = record.child<NExpression>();
+            if( !_failed )
+                node = make<NDeleteStatement>(expression);
+            break;
+        }
+        default:
+            fail("unknown node kind");
+            break;
+    }
+
+    if( node )
+        _built[offset] = node;
+    return node;
+}
+
+bool ASTReader::read(const SourceBuffer &source) {
+    return read(source.data(), source.size(), source.path());
+}
+
+bool ASTReader::read(const char *data, size_t size, const std::string &path) {
+    TraceScope timeScope("Load AST", path);
+    _path = path;
+    _data = data;
+    _size = size;
+
+    ASTFileHeader header;
+    if( !isAST(_data, _size) )
+        return fail("bad magic");
+    memcpy(&header, _data, sizeof(header));
+    if( header.byteOrder != byteOrderMark )
+        return fail("written on a machine with a different byte order");
+    if( header.version != TINYCOMPILER_AST_VERSION ){
+        fprintf(stderr, "%s is AST format version %u, this compiler reads version %u\n",
+                _path.c_str(), header.version, TINYCOMPILER_AST_VERSION);
+        return false;
+    }
+    if( header.nodesOffset > _size || header.nodesSize > _size - header.nodesOffset
+        || header.stringsOffset > header.nodesOffset )
+        return fail("section out of range");
+    _nodes = _data + header.nodesOffset;
+    _nodesSize = header.nodesSize;
+
+    // strings go into the context's pool so the nodes get ordinary Symbols
+    _strings.reserve(header.stringCount);
+    size_t position = header.stringsOffset;
+    for(uint32_t i=0; i<header.stringCount; i++){
+        uint32_t length;
+        if( position + sizeof(length) > header.nodesOffset )
+            return fail("string table runs into the nodes");
+        memcpy(&length, _data + position, sizeof(length));
+        position += sizeof(length);
+        if( length > header.nodesOffset - position )
+            return fail("string table runs into the nodes");
+        _strings.push_back(_context.symbols.symbol(llvm::StringRef(_data + position, length)));
+        position += length + padding(length);
+    }
+
+    // one block for every node, each record is at least one word long
+    size_t slabSize = 0;
+    size_t nodeCount = 0;
+    for(size_t kind=0; kind<(size_t)ASTKind::Count; kind++){
+        nodeCount += header.kindCounts[kind];
+        slabSize += header.kindCounts[kind] * nodeSize((ASTKind)kind);
+    }
+    if( nodeCount > _nodesSize / sizeof(uint32_t) )
+        return fail("node counts don't match the node section");
+    _slab = static_cast<char*>(_context.arena.allocate(slabSize, alignof(std::max_align_t)));
+    _slabLeft = slabSize;
+
+    NBlock* program = nullptr;
+    if( header.root < _nodesSize ){
+        program = dynamic_cast<NBlock*>(build(header.root));
+    }
+    if( _failed || !program )
+        return fail("no program block");
+
+    _context.appendProgram(program);
+    return true;
+}
@@ -0,0 +1,199 @@
+//
+// Versioned binary form of the AST, written after parsing and loaded back
+// instead of running the scanner and parser again.
+//
+
+#ifndef TINYCOMPILER_ASTSERIALIZER_H
+#define TINYCOMPILER_ASTSERIALIZER_H
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ASTNodes.h"
+
+class ParseContext;
+class SourceBuffer;
+
+// File layout, all integers in host byte order and 4 byte aligned:
+//
+//   ASTFileHeader
+//   string table    stringCount x { uint32 length, bytes, padding }
+//   node records    { uint32 kind, fields... }, children before parents
+//
+// Children are referred to by their byte offset in the node section, which
+// is always smaller than the offset of the record referring to them. Child
+// lists are stored inline as a count followed by that many offsets.
+// Bump TINYCOMPILER_AST_VERSION whenever a record changes shape.
+#define TINYCOMPILER_AST_MAGIC "\177AST"
+#define TINYCOMPILER_AST_VERSION 6
+
+enum class ASTKind: uint32_t{
+    Double = 1,
+    Integer,
+    Identifier,
+    MethodCall,
+    BinaryOperator,
+    Assignment,
+    Block,
+    ExpressionStatement,
+    VariableDeclaration,
+    FunctionDeclaration,
+    StructDeclaration,
+    ReturnStatement,
+    IfStatement,
+    ForStatement,
+    StructMember,
+    ArrayIndex,
+    ArrayAssignment,
+    ArrayInitialization,
+    StructAssignment,
+    Literal,
+    UnaryOperator,
+    BreakStatement,
+    ContinueStatement,
+    NewExpression,
+    DeleteStatement,
+    Count
+};
+
+struct ASTFileHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;         // 0x01020304 as written, catches foreign files
+    uint32_t stringCount;
+    uint32_t stringsOffset;     // from the start of the file
+    uint32_t nodesOffset;
+    uint32_t nodesSize;
+    uint32_t root;              // offset of the program block in the node section
+    uint32_t kindCounts[(size_t)ASTKind::Count];    // lets the reader size its slab up front
+};
+
+class ASTWriter{
+private:
+    std::string _nodes;
+    std::vector<Symbol> _strings;
+    llvm::DenseMap<SymbolID, uint32_t> _stringIndex;
+    llvm::DenseMap<const Node*, uint32_t> _written;
+    uint32_t _kindCounts[(size_t)ASTKind::Count] = {};
+    bool _failed = false;
+
+    void append(const void* data, size_t size){
+        _nodes.append(static_cast<const char*>(data), size);
+    }
+
+public:
+    static const uint32_t nullOffset = 0xffffffff;
+
+    // Serialize the program and everything reachable from it
+    bool write(const NBlock& program, const std::string& path);
+
+    // Write a child and return its offset, nullOffset for nullptr. Must be
+    // called for every child before the parent's record is begun.
+    uint32_t node(const Node* node);
+
+    template<typename List>
+    llvm::SmallVector<uint32_t, 8> list(const List* list){
+        llvm::SmallVector<uint32_t, 8> offsets;
+        if( list ){
+            for(auto it=list->begin(); it!=list->end(); it++)
+                offsets.push_back(node(*it));
+        }
+        return offsets;
+    }
+
+    // Start the record of the node being written, returns its offset
+    uint32_t begin(ASTKind kind);
+
+    void u32(uint32_t value){
+        append(&value, sizeof(value));
+    }
+
+    void u64(uint64_t value){
+        append(&value, sizeof(value));
+    }
+
+    void f64(double value){
+        append(&value, sizeof(value));
+    }
+
+    void symbol(Symbol symbol);
+
+    // A list that was null on the node is written as nullOffset entries
+    void offsets(const llvm::SmallVectorImpl<uint32_t>& offsets, bool present){
+        u32(present ? (uint32_t)offsets.size() : nullOffset);
+        for(auto offset: offsets)
+            u32(offset);
+    }
+
+    // Called for node types without a record, fails the whole write
+    uint32_t unsupported(const Node& node);
+};
+
+// Rebuilds the tree into a ParseContext. The file stays mapped only while
+// reading; the nodes are constructed in one arena block sized from the
+// header's kind counts, and their strings are interned in the context's pool.
+class ASTReader{
+private:
+    ParseContext& _context;
+    std::string _path;
+    const char* _data = nullptr;
+    size_t _size = 0;
+    const char* _nodes = nullptr;
+    uint32_t _nodesSize = 0;
+    std::vector<Symbol> _strings;
+    llvm::DenseMap<uint32_t, Node*> _built;
+    char* _slab = nullptr;
+    size_t _slabLeft = 0;
+    bool _failed = false;
+
+    bool fail(const char* message);
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args);
+
+    Node* build(uint32_t offset);
+
+    template<typename T>
+    T* child(uint32_t offset, uint32_t parent, bool required);
+
+public:
+    explicit ASTReader(ParseContext& context): _context(context){}
+
+    static bool isAST(const char* data, size_t size){
+        return size >= sizeof(ASTFileHeader) && memcmp(data, TINYCOMPILER_AST_MAGIC, 4) == 0;
+    }
+
+    // Append the stored program to the context's program, like a parse would
+    bool read(const SourceBuffer& source);
+
+    // The same for a file already in memory, e.g. one sent to the daemon;
+    // data only has to stay valid during the call
+    bool read(const char* data, size_t size, const std::string& path);
+
+    // Cursor over one record, used by the per-kind builders
+    struct Record{
+        ASTReader& reader;
+        uint32_t offset;
+        uint32_t position;
+
+        uint32_t u32();
+        uint64_t u64();
+        double f64();
+        Symbol symbol();
+
+        template<typename T>
+        T* child(bool required = true){
+            return reader.child<T>(u32(), offset, required);
+        }
+
+        template<typename List>
+        List* list(bool required = true);
+    };
+};
+
+#endif //TINYCOMPILER_ASTSERIALIZER_H
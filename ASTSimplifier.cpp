@@ -0,0 +1,395 @@
+//
+// Constant folding, algebraic identities and propagation of literal-initialised
+// variables, run on the AST before code generation.
+//
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "ASTSimplifier.h"
+#include "TimeTrace.h"
+#include "Trace.h"
+#include "grammar.hpp"
+
+// NInteger::codeGen truncates to i32, so fold with the same width
+static int32_t intValue(const NInteger& integer){
+    return (int32_t)(uint32_t)integer.value;
+}
+
+static bool isInt(const NExpression* expression, int32_t value){
+    auto integer = dynamic_cast<const NInteger*>(expression);
+    return integer && intValue(*integer) == value;
+}
+
+static bool isDouble(const NExpression* expression, double value){
+    auto number = dynamic_cast<const NDouble*>(expression);
+    return number && number->value == value && std::signbit(number->value) == std::signbit(value);
+}
+
+// Reading these has no side effect, so they may be dropped from x * 0
+static bool isPure(const NExpression* expression){
+    return dynamic_cast<const NIdentifier*>(expression) || dynamic_cast<const NInteger*>(expression)
+           || dynamic_cast<const NDouble*>(expression);
+}
+
+unsigned ASTSimplifier::run(NBlock &program) {
+    TraceScope timeScope("Simplify AST");
+    _rewrites = 0;
+
+    // the first walk folds and finds every reassigned variable, the second
+    // also propagates, then folds what the propagated literals made constant
+    for(bool propagate: {false, true}){
+        _propagate = propagate;
+        _bindings.clear();
+        _innermost.clear();
+        _scopes.clear();
+        program.simplify(*this);
+    }
+
+    TRACE(CodeGen, 1, "Simplified " << _rewrites << " expressions");
+    return _rewrites;
+}
+
+NExpression *ASTSimplifier::expression(NExpression *expression) {
+    if( !expression )
+        return nullptr;
+    return static_cast<NExpression*>(expression->simplify(*this));
+}
+
+void ASTSimplifier::openScope() {
+    _scopes.push_back(_bindings.size());
+}
+
+void ASTSimplifier::closeScope() {
+    size_t mark = _scopes.back();
+    _scopes.pop_back();
+    while( _bindings.size() > mark ){
+        auto& binding = _bindings.back();
+        if( binding.shadowed >= 0 )
+            _innermost[binding.name] = binding.shadowed;
+        else
+            _innermost.erase(binding.name);
+        _bindings.pop_back();
+    }
+}
+
+void ASTSimplifier::declare(NVariableDeclaration &declaration) {
+    SymbolID name = declaration.id->name.id();
+    auto innermost = _innermost.find(name);
+    int32_t shadowed = innermost == _innermost.end() ? -1 : innermost->second;
+    _innermost[name] = (int32_t)_bindings.size();
+    _bindings.push_back(Binding{name, &declaration, _scopes.size(), shadowed});
+}
+
+const ASTSimplifier::Binding *ASTSimplifier::lookup(Symbol name) const {
+    auto innermost = _innermost.find(name.id());
+    return innermost == _innermost.end() ? nullptr : &_bindings[innermost->second];
+}
+
+void ASTSimplifier::assigned(Symbol name) {
+    auto binding = lookup(name);
+    if( binding )
+        _reassigned.insert(binding->declaration);
+}
+
+ASTSimplifier::Kind ASTSimplifier::kindOf(const NExpression *expression) const {
+    if( dynamic_cast<const NInteger*>(expression) )
+        return Int;
+    if( dynamic_cast<const NDouble*>(expression) )
+        return Double;
+
+    if( auto identifier = dynamic_cast<const NIdentifier*>(expression) ){
+        auto binding = lookup(identifier->name);
+        if( !binding || binding->declaration->type->isArray || binding->declaration->type->isPointer )
+            return Unknown;
+        const std::string& type = binding->declaration->type->name.str();
+        return type == "int" ? Int : type == "double" ? Double : Unknown;
+    }
+
+    if( auto binary = dynamic_cast<const NBinaryOperator*>(expression) ){
+        Kind lhs = kindOf(binary->lhs);
+        if( lhs == Unknown || lhs != kindOf(binary->rhs) )
+            return Unknown;
+        switch( binary->op ){
+            case TPLUS: case TMINUS: case TMUL: case TDIV:
+                return lhs;
+            case TAND: case TOR: case TXOR: case TSHIFTL: case TSHIFTR:
+                return lhs == Int ? Int : Unknown;
+            default:
+                return Unknown;
+        }
+    }
+    return Unknown;
+}
+
+NVariableDeclaration *ASTSimplifier::constantDeclaration(Symbol name) const {
+    auto binding = lookup(name);
+    if( !binding || binding->depth == 0 || _reassigned.count(binding->declaration) )
+        return nullptr;
+
+    auto declaration = binding->declaration;
+    if( declaration->type->isArray || declaration->type->isPointer )
+        return nullptr;
+    const std::string& type = declaration->type->name.str();
+    if( (type == "int" && dynamic_cast<NInteger*>(declaration->assignmentExpr))
+        || (type == "double" && dynamic_cast<NDouble*>(declaration->assignmentExpr)) )
+        return declaration;
+    return nullptr;
+}
+
+NExpression *ASTSimplifier::propagate(NIdentifier &identifier) {
+    if( !_propagate )
+        return &identifier;
+    auto declaration = constantDeclaration(identifier.name);
+    if( !declaration )
+        return &identifier;
+
+    _rewrites++;
+    TRACE(CodeGen, 2, "Propagated " << identifier.name);
+    if( auto integer = dynamic_cast<NInteger*>(declaration->assignmentExpr) )
+        return _arena.make<NInteger>(integer->value);
+    return _arena.make<NDouble>(static_cast<NDouble*>(declaration->assignmentExpr)->value);
+}
+
+NExpression *ASTSimplifier::fold(NBinaryOperator &node) {
+    auto lhsInt = dynamic_cast<NInteger*>(node.lhs);
+    auto rhsInt = dynamic_cast<NInteger*>(node.rhs);
+    if( lhsInt && rhsInt ){
+        int32_t a = intValue(*lhsInt), b = intValue(*rhsInt);
+        uint32_t result;
+        switch( node.op ){
+            case TPLUS:     result = (uint32_t)a + (uint32_t)b; break;
+            case TMINUS:    result = (uint32_t)a - (uint32_t)b; break;
+            case TMUL:      result = (uint32_t)a * (uint32_t)b; break;
+            case TDIV:
+                if( b == 0 || (a == std::numeric_limits<int32_t>::min() && b == -1) )
+                    return nullptr;
+                result = (uint32_t)(a / b);
+                break;
+            case TAND:      result = (uint32_t)a & (uint32_t)b; break;
+            case TOR:       result = (uint32_t)a | (uint32_t)b; break;
+            case TXOR:      result = (uint32_t)a ^ (uint32_t)b; break;
+            case TSHIFTL:
+                if( b < 0 || b > 31 )
+                    return nullptr;
+                result = (uint32_t)a << b;
+                break;
+            case TSHIFTR:
+                if( b < 0 || b > 31 )
+                    return nullptr;
+                result = (uint32_t)(a >> b);
+                break;
+            default:
+                return nullptr;
+        }
+        return _arena.make<NInteger>(result);
+    }
+
+    auto lhsDouble = dynamic_cast<NDouble*>(node.lhs);
+    auto rhsDouble = dynamic_cast<NDouble*>(node.rhs);
+    if( lhsDouble && rhsDouble ){
+        double a = lhsDouble->value, b = rhsDouble->value;
+        switch( node.op ){
+            case TPLUS:     return _arena.make<NDouble>(a + b);
+            case TMINUS:    return _arena.make<NDouble>(a - b);
+            case TMUL:      return _arena.make<NDouble>(a * b);
+            case TDIV:      return b == 0 ? nullptr : _arena.make<NDouble>(a / b);
+            default:        return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+NExpression *ASTSimplifier::applyIdentity(NBinaryOperator &node) {
+    NExpression* lhs = node.lhs;
+    NExpression* rhs = node.rhs;
+    Kind kind = kindOf(lhs);
+    if( kind == Unknown || kind != kindOf(rhs) )
+        return nullptr;
+
+    if( kind == Double ){
+        // exact for every double including NaN and -0.0, unlike x + 0.0
+        switch( node.op ){
+            case TMUL:
+                if( isDouble(rhs, 1) ) return lhs;
+                if( isDouble(lhs, 1) ) return rhs;
+                return nullptr;
+            case TDIV:
+                return isDouble(rhs, 1) ? lhs : nullptr;
+            case TMINUS:
+                return isDouble(rhs, 0) ? lhs : nullptr;
+            default:
+                return nullptr;
+        }
+    }
+
+    switch( node.op ){
+        case TPLUS:
+        case TOR:
+        case TXOR:
+            if( isInt(rhs, 0) ) return lhs;
+            if( isInt(lhs, 0) ) return rhs;
+            return nullptr;
+        case TMINUS:
+        case TSHIFTL:
+        case TSHIFTR:
+            return isInt(rhs, 0) ? lhs : nullptr;
+        case TMUL:
+            if( isInt(rhs, 1) ) return lhs;
+            if( isInt(lhs, 1) ) return rhs;
+            if( isInt(rhs, 0) && isPure(lhs) ) return rhs;
+            if( isInt(lhs, 0) && isPure(rhs) ) return lhs;
+            return nullptr;
+        case TDIV:
+            return isInt(rhs, 1) ? lhs : nullptr;
+        case TAND:
+            if( isInt(rhs, -1) ) return lhs;
+            if( isInt(lhs, -1) ) return rhs;
+            if( isInt(rhs, 0) && isPure(lhs) ) return rhs;
+            if( isInt(lhs, 0) && isPure(rhs) ) return lhs;
+            return nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+NExpression *ASTSimplifier::simplify(NBinaryOperator &node) {
+    node.lhs = expression(node.lhs);
+    node.rhs = expression(node.rhs);
+    if( !node.lhs || !node.rhs )
+        return &node;
+
+    NExpression* result = fold(node);
+    if( !result )
+        result = applyIdentity(node);
+    if( !result )
+        return &node;
+
+    _rewrites++;
+    return result;
+}
+
+/*
+ * Per node walks. Expression slots are replaced by what the walk returns,
+ * statements always return themselves.
+ */
+
+Node* Node::simplify(ASTSimplifier &simplifier) {
+    return this;
+}
+
+Node* NIdentifier::simplify(ASTSimplifier &simplifier) {
+    return simplifier.propagate(*this);
+}
+
+Node* NMethodCall::simplify(ASTSimplifier &simplifier) {
+    simplifier.expressions(arguments);
+    return this;
+}
+
+Node* NBinaryOperator::simplify(ASTSimplifier &simplifier) {
+    return simplifier.simplify(*this);
+}
+
+Node* NUnaryOperator::simplify(ASTSimplifier &simplifier) {
+    // !x is an i1, there is no literal of that type to fold it into
+    expression = simplifier.expression(expression);
+    return this;
+}
+
+Node* NNewExpression::simplify(ASTSimplifier &simplifier) {
+    count = simplifier.expression(count);
+    return this;
+}
+
+Node* NDeleteStatement::simplify(ASTSimplifier &simplifier) {
+    expression = simplifier.expression(expression);
+    return this;
+}
+
+Node* NAssignment::simplify(ASTSimplifier &simplifier) {
+    rhs = simplifier.expression(rhs);
+    simplifier.assigned(lhs->name);
+    return this;
+}
+
+Node* NBlock::simplify(ASTSimplifier &simplifier) {
+    simplifier.list(statements);
+    return this;
+}
+
+Node* NExpressionStatement::simplify(ASTSimplifier &simplifier) {
+    expression = simplifier.expression(expression);
+    return this;
+}
+
+// declared before the initialiser is generated, as in codeGen
+Node* NVariableDeclaration::simplify(ASTSimplifier &simplifier) {
+    simplifier.declare(*this);
+    assignmentExpr = simplifier.expression(assignmentExpr);
+    return this;
+}
+
+Node* NFunctionDeclaration::simplify(ASTSimplifier &simplifier) {
+    if( isExternal || !block )
+        return this;
+    simplifier.openScope();
+    for(auto it=arguments->begin(); it!=arguments->end(); it++){
+        simplifier.declare(**it);
+    }
+    block->simplify(simplifier);
+    simplifier.closeScope();
+    return this;
+}
+
+Node* NReturnStatement::simplify(ASTSimplifier &simplifier) {
+    expression = simplifier.expression(expression);
+    return this;
+}
+
+Node* NIfStatement::simplify(ASTSimplifier &simplifier) {
+    condition = simplifier.expression(condition);
+    simplifier.openScope();
+    trueBlock->simplify(simplifier);
+    simplifier.closeScope();
+    if( falseBlock ){
+        simplifier.openScope();
+        falseBlock->simplify(simplifier);
+        simplifier.closeScope();
+    }
+    return this;
+}
+
+// the body is a scope of its own, the increment is generated after it closes
+Node* NForStatement::simplify(ASTSimplifier &simplifier) {
+    initial = simplifier.expression(initial);
+    condition = simplifier.expression(condition);
+    simplifier.openScope();
+    block->simplify(simplifier);
+    simplifier.closeScope();
+    increment = simplifier.expression(increment);
+    return this;
+}
+
+Node* NArrayIndex::simplify(ASTSimplifier &simplifier) {
+    simplifier.expressions(expressions);
+    return this;
+}
+
+Node* NArrayAssignment::simplify(ASTSimplifier &simplifier) {
+    arrayIndex->simplify(simplifier);
+    expression = simplifier.expression(expression);
+    return this;
+}
+
+Node* NArrayInitialization::simplify(ASTSimplifier &simplifier) {
+    declaration->simplify(simplifier);
+    simplifier.expressions(expressionList);
+    return this;
+}
+
+Node* NStructAssignment::simplify(ASTSimplifier &simplifier) {
+    expression = simplifier.expression(expression);
+    return this;
+}
@@ -0,0 +1,93 @@
+//
+// Constant folding, algebraic identities and propagation of literal-initialised
+// variables, run on the AST before code generation.
+//
+
+#ifndef TINYCOMPILER_ASTSIMPLIFIER_H
+#define TINYCOMPILER_ASTSIMPLIFIER_H
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "ASTNodes.h"
+
+// Only rewrites what the code generator would have computed the same way:
+// int (i32, wrapping) with int and double with double, never a mix, and
+// nothing that could trap or change type, i.e. no comparisons, no modulo,
+// no division by zero and no shifts out of range. Replacement nodes are
+// allocated in the arena that owns the tree.
+//
+// Scopes mirror CodeGenContext's blocks (function, then/else, loop body), so
+// a name resolves here to the declaration codegen will use. A local whose
+// initialiser is a literal of its own type and that is never assigned again
+// is replaced by that literal at every use. Top-level variables are left
+// alone, since the REPL keeps them as globals that later inputs may assign.
+class ASTSimplifier{
+public:
+    enum Kind{
+        Unknown,
+        Int,
+        Double
+    };
+
+private:
+    struct Binding{
+        SymbolID name;
+        NVariableDeclaration* declaration;
+        size_t depth;
+        int32_t shadowed;
+    };
+
+    Arena& _arena;
+    std::vector<Binding> _bindings;
+    llvm::DenseMap<SymbolID, int32_t> _innermost;
+    std::vector<size_t> _scopes;                // _bindings.size() when each scope opened
+    llvm::DenseSet<NVariableDeclaration*> _reassigned;
+    bool _propagate = false;                    // second walk, after every assignment is known
+    unsigned _rewrites = 0;
+
+    const Binding* lookup(Symbol name) const;
+    NVariableDeclaration* constantDeclaration(Symbol name) const;
+    NExpression* fold(NBinaryOperator& node);
+    NExpression* applyIdentity(NBinaryOperator& node);
+
+public:
+    explicit ASTSimplifier(Arena& arena): _arena(arena){}
+
+    // Simplify the program in place, returns the number of rewrites
+    unsigned run(NBlock& program);
+
+    // Simplified replacement for an expression slot, nullptr stays nullptr
+    NExpression* expression(NExpression* expression);
+
+    template<typename List>
+    void list(List* list){
+        if( !list )
+            return;
+        for(auto it=list->begin(); it!=list->end(); it++){
+            if( *it )
+                (*it)->simplify(*this);
+        }
+    }
+
+    void expressions(ExpressionList* list){
+        if( !list )
+            return;
+        for(auto it=list->begin(); it!=list->end(); it++)
+            *it = expression(*it);
+    }
+
+    void openScope();
+    void closeScope();
+    void declare(NVariableDeclaration& declaration);
+    void assigned(Symbol name);
+
+    Kind kindOf(const NExpression* expression) const;
+    NExpression* propagate(NIdentifier& identifier);
+    NExpression* simplify(NBinaryOperator& node);
+};
+
+#endif //TINYCOMPILER_ASTSIMPLIFIER_H
@@ -0,0 +1,130 @@
+//
+// Bump allocation for everything that lives as long as one compilation.
+//
+
+#ifndef TINYCOMPILER_ARENA_H
+#define TINYCOMPILER_ARENA_H
+
+#include <llvm/Support/Allocator.h>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Objects are carved out of large slabs and released together when the arena
+// is reset or destroyed. Destructors still run (in reverse order) for types
+// that need one; AST nodes and child lists do not, so a parse registers none.
+class Arena{
+private:
+    struct Destructor{
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    llvm::BumpPtrAllocator _allocator;
+    std::vector<Destructor> _destructors;
+
+    template<typename T>
+    static void destroy(void* object){
+        static_cast<T*>(object)->~T();
+    }
+
+public:
+    Arena(){}
+
+    ~Arena(){
+        reset();
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment){
+        return _allocator.Allocate(size, alignment);
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args){
+        return construct<T>(allocate(sizeof(T), alignof(T)), std::forward<Args>(args)...);
+    }
+
+    // Construct in storage already taken from this arena, e.g. one block
+    // carved up by a caller that knows the total size in advance
+    template<typename T, typename... Args>
+    T* construct(void* place, Args&&... args){
+        T* object = new(place) T(std::forward<Args>(args)...);
+        if( !std::is_trivially_destructible<T>::value ){
+            _destructors.push_back(Destructor{object, &Arena::destroy<T>});
+        }
+        return object;
+    }
+
+    // Child lists use ArenaAllocator, so their element storage is bump
+    // allocated as well. Their destructor would only hand that storage back
+    // to the arena, so none is registered.
+    template<typename List>
+    List* makeList();
+
+    void reset(){
+        for(auto it=_destructors.rbegin(); it!=_destructors.rend(); it++){
+            it->destroy(it->object);
+        }
+        _destructors.clear();
+        _allocator.Reset();
+    }
+
+    size_t bytesAllocated() const{
+        return _allocator.getBytesAllocated();
+    }
+};
+
+// STL allocator over an Arena. Deallocation is a no-op, the memory goes back
+// when the arena does. A default constructed allocator has no arena and falls
+// back to the heap, which keeps short-lived lists built on the stack usable.
+template<typename T>
+class ArenaAllocator{
+public:
+    using value_type = T;
+
+    Arena* arena = nullptr;
+
+    ArenaAllocator(){}
+
+    ArenaAllocator(Arena* arena): arena(arena){}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other): arena(other.arena){}
+
+    T* allocate(size_t n){
+        if( arena )
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t){
+        if( !arena )
+            ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const{
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const{
+        return arena != other.arena;
+    }
+};
+
+template<typename List>
+List* Arena::makeList(){
+    static_assert(std::is_trivially_destructible<typename List::value_type>::value,
+                  "list elements would need destructors");
+    void* place = allocate(sizeof(List), alignof(List));
+    return new(place) List(ArenaAllocator<typename List::value_type>(this));
+}
+
+#endif //TINYCOMPILER_ARENA_H
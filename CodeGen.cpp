@@ -2,6 +2,7 @@
 // Created by cs on 2017/5/28.
 //
 
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
@@ -13,6 +14,8 @@
 #include "CodeGen.h"
 #include "ASTNodes.h"
 #include "TypeSystem.h"
+#include "TimeTrace.h"
+#include "Trace.h"
 using legacy::PassManager;
 #define ISTYPE(value, id) (value->getType()->getTypeID() == id)
 
@@ -26,15 +29,17 @@ using legacy::PassManager;
  */
 
 //
-static Type* TypeOf(const NIdentifier & type, CodeGenContext& context){        // get llvm::type of variable base on its identifier
+Type* TypeOf(const NIdentifier & type, CodeGenContext& context){        // get llvm::type of variable base on its identifier
     return context.typeSystem.getVarType(type);
 }
 
 static Value* CastToBoolean(CodeGenContext& context, Value* condValue){
 
     if( ISTYPE(condValue, Type::IntegerTyID) ){
-        condValue = context.builder.CreateIntCast(condValue, Type::getInt1Ty(context.llvmContext), true);
-        return context.builder.CreateICmpNE(condValue, ConstantInt::get(Type::getInt1Ty(context.llvmContext), 0, true));
+        if( condValue->getType()->isIntegerTy(1) )
+            return condValue;
+        // compare against zero, truncating to i1 would make 2 false
+        return context.builder.CreateICmpNE(condValue, ConstantInt::get(condValue->getType(), 0, true));
     }else if( ISTYPE(condValue, Type::DoubleTyID) ){
         return context.builder.CreateFCmpONE(condValue, ConstantFP::get(context.llvmContext, APFloat(0.0)));
     }else{
@@ -42,24 +47,64 @@ static Value* CastToBoolean(CodeGenContext& context, Value* condValue){
     }
 }
 
-static llvm::Value* calcArrayIndex(shared_ptr<NArrayIndex> index, CodeGenContext &context){
-    auto sizeVec = context.getArraySize(index->arrayName->name);
-    cout << "sizeVec:" << sizeVec.size() << ", expressions: " << index->expressions->size() << endl;
-    assert(sizeVec.size() > 0 && sizeVec.size() == index->expressions->size());
-    auto expression = *(index->expressions->rbegin());
+// a[i][j] is one getelementptr. A local or global array is a nested
+// [N x [M x T]] indexed {0, i, j}; an array parameter holds the decayed
+// [M x T]* and is indexed {i, j}. Every dimension stays visible to LLVM.
+static llvm::Value* arrayElementPtr(const NArrayIndex& index, CodeGenContext &context){
+    Value* arrayPtr = context.getSymbolValue(index.arrayName->name);
+    if( !arrayPtr ){
+        return LogErrorV("Unknown variable name " + index.arrayName->name.str());
+    }
+
+    SmallVector<Value*, 4> indices;
+    unsigned dimensions = 0;
+    Type* elementType = arrayPtr->getType()->getPointerElementType();
+    if( elementType->isArrayTy() ){
+        indices.push_back(ConstantInt::get(context.typeSystem.intTy, 0));
+    }else if( elementType->isPointerTy() ){
+        arrayPtr = context.builder.CreateLoad(arrayPtr, "arrayPtr");
+        elementType = elementType->getPointerElementType();
+        dimensions++;
+    }else{
+        return LogErrorV("The variable is not array");
+    }
+    for(; elementType->isArrayTy(); elementType = elementType->getArrayElementType()){
+        dimensions++;
+    }
+
+    TRACE(CodeGen, 2, "dimensions: " << dimensions << ", expressions: " << index.expressions->size());
+    if( index.expressions->size() != dimensions ){
+        return LogErrorV("Array " + index.arrayName->name.str() + " needs " + std::to_string(dimensions) + " indices");
+    }
+    for(auto expression: *index.expressions){
+        Value* value = expression->codeGen(context);
+        if( !value )
+            return nullptr;
+        indices.push_back(value);
+    }
+
+    return context.builder.CreateInBoundsGEP(arrayPtr, indices, "elementPtr");
+}
 
-    for(unsigned int i=sizeVec.size()-1; i>=1; i--){
-        auto temp = make_shared<NBinaryOperator>(make_shared<NInteger>(sizeVec[i]), TMUL, index->expressions->at(i-1));
-//        cout << "2" << endl;
-        expression = make_shared<NBinaryOperator>(temp, TPLUS, expression);
-//        cout << "3" << endl;
+AllocaInst* CodeGenContext::createEntryAlloca(Type* type, const Twine& name) {
+    BasicBlock* insertBlock = builder.GetInsertBlock();
+    if( !insertBlock || !insertBlock->getParent() ){
+        return builder.CreateAlloca(type, nullptr, name);
     }
 
-    return expression->codeGen(context);
+    // keep allocas in declaration order at the top of the entry block
+    BasicBlock& entry = insertBlock->getParent()->getEntryBlock();
+    auto insertPoint = entry.begin();
+    while( insertPoint != entry.end() && isa<AllocaInst>(*insertPoint) ){
+        insertPoint++;
+    }
+    IRBuilder<> entryBuilder(&entry, insertPoint);
+    return entryBuilder.CreateAlloca(type, nullptr, name);
 }
 
 void CodeGenContext::generateCode(NBlock& root) {
-    cout << "Generating IR code" << endl;
+    TraceScope timeScope("CodeGen");
+    TRACE(CodeGen, 1, "Generating IR code");
 
     std::vector<Type*> sysArgs;
     FunctionType* mainFuncType = FunctionType::get(Type::getVoidTy(this->llvmContext), makeArrayRef(sysArgs), false);
@@ -70,34 +115,82 @@ void CodeGenContext::generateCode(NBlock& root) {
     Value* retValue = root.codeGen(*this);
     popBlock();
 
-    cout << "Code generate success" << endl;
+    TRACE(CodeGen, 1, "Code generate success");
 
-    PassManager passManager;
-    passManager.add(createPrintModulePass(outs()));
-    passManager.run(*(this->theModule.get()));
+    if( printIR ){
+        TraceScope printScope("Print IR");
+        PassManager passManager;
+        passManager.add(createPrintModulePass(outs()));
+        passManager.run(*(this->theModule.get()));
+    }
     return;
 }
 
 llvm::Value* NAssignment::codeGen(CodeGenContext &context) {
-    cout << "Generating assignment of " << this->lhs->name << " = " << endl;
+    TRACE(CodeGen, 2, "Generating assignment of " << this->lhs->name << " = ");
     Value* dst = context.getSymbolValue(this->lhs->name);
     auto dstType = context.getSymbolType(this->lhs->name);
-    string dstTypeStr = dstType->name;
     if( !dst ){
         return LogErrorV("Undeclared variable");
     }
+    if( dstType->isConst ){
+        return LogErrorV("Cannot assign to const reference " + this->lhs->name.str());
+    }
     Value* exp = exp = this->rhs->codeGen(context);
 
-    cout << "dst typeid = " << TypeSystem::llvmTypeToStr(context.typeSystem.getVarType(dstTypeStr)) << endl;
-    cout << "exp typeid = " << TypeSystem::llvmTypeToStr(exp) << endl;
+    // what dst holds, which for pointers and ref parameters is more than the type name says
+    Type* dstValueType = dst->getType()->getPointerElementType();
+    TRACE(CodeGen, 2, "dst typeid = " << TypeSystem::llvmTypeToStr(dstValueType));
+    TRACE(CodeGen, 2, "exp typeid = " << TypeSystem::llvmTypeToStr(exp));
 
-    exp = context.typeSystem.cast(exp, context.typeSystem.getVarType(dstTypeStr), context.currentBlock());
+    exp = context.typeSystem.cast(exp, dstValueType, context.builder.GetInsertBlock());
     context.builder.CreateStore(exp, dst);
     return dst;
 }
 
+// a && b and a || b only evaluate b when a does not decide the result:
+//
+//   lhs:  br a, rhs, end     (br a, end, rhs for ||)
+//   rhs:  br end
+//   end:  phi i1 [false/true, lhs], [b, rhs]
+static Value* shortCircuit(const NBinaryOperator& node, CodeGenContext& context){
+    bool isAnd = node.op == TLAND;
+    Value* L = node.lhs->codeGen(context);
+    if( !L )
+        return nullptr;
+    L = CastToBoolean(context, L);
+
+    Function* theFunction = context.builder.GetInsertBlock()->getParent();
+    BasicBlock* lhsBB = context.builder.GetInsertBlock();
+    BasicBlock* rhsBB = BasicBlock::Create(context.llvmContext, isAnd ? "land.rhs" : "lor.rhs", theFunction);
+    BasicBlock* endBB = BasicBlock::Create(context.llvmContext, isAnd ? "land.end" : "lor.end");
+
+    if( isAnd )
+        context.builder.CreateCondBr(L, rhsBB, endBB);
+    else
+        context.builder.CreateCondBr(L, endBB, rhsBB);
+
+    context.builder.SetInsertPoint(rhsBB);
+    Value* R = node.rhs->codeGen(context);
+    if( !R )
+        return nullptr;
+    R = CastToBoolean(context, R);
+    rhsBB = context.builder.GetInsertBlock();       // the right side may have branched itself
+    context.builder.CreateBr(endBB);
+
+    theFunction->getBasicBlockList().push_back(endBB);
+    context.builder.SetInsertPoint(endBB);
+    PHINode* phi = context.builder.CreatePHI(Type::getInt1Ty(context.llvmContext), 2, isAnd ? "landtmp" : "lortmp");
+    phi->addIncoming(ConstantInt::get(Type::getInt1Ty(context.llvmContext), isAnd ? 0 : 1), lhsBB);
+    phi->addIncoming(R, rhsBB);
+    return phi;
+}
+
 llvm::Value* NBinaryOperator::codeGen(CodeGenContext &context) {
-    cout << "Generating binary operator" << endl;
+    TRACE(CodeGen, 2, "Generating binary operator");
+
+    if( this->op == TLAND || this->op == TLOR )
+        return shortCircuit(*this, context);
 
     Value* L = this->lhs->codeGen(context);
     Value* R = this->rhs->codeGen(context);
@@ -116,9 +209,9 @@ llvm::Value* NBinaryOperator::codeGen(CodeGenContext &context) {
     if( !L || !R ){
         return nullptr;
     }
-    cout << "fp = " << ( fp ? "true" : "false" ) << endl;
-    cout << "L is " << TypeSystem::llvmTypeToStr(L) << endl;
-    cout << "R is " << TypeSystem::llvmTypeToStr(R) << endl;
+    TRACE(CodeGen, 2, "fp = " << ( fp ? "true" : "false" ));
+    TRACE(CodeGen, 2, "L is " << TypeSystem::llvmTypeToStr(L));
+    TRACE(CodeGen, 2, "R is " << TypeSystem::llvmTypeToStr(R));
 
     switch (this->op){
         case TPLUS:
@@ -157,8 +250,22 @@ llvm::Value* NBinaryOperator::codeGen(CodeGenContext &context) {
     }
 }
 
+llvm::Value* NUnaryOperator::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating unary operator");
+    Value* value = this->expression->codeGen(context);
+    if( !value )
+        return nullptr;
+
+    switch( this->op ){
+        case TNOT:
+            return context.builder.CreateNot(CastToBoolean(context, value), "nottmp");
+        default:
+            return LogErrorV("Unknown unary operator");
+    }
+}
+
 llvm::Value* NBlock::codeGen(CodeGenContext &context) {
-    cout << "Generating block" << endl;
+    TRACE(CodeGen, 2, "Generating block");
     Value* last = nullptr;
     for(auto it=this->statements->begin(); it!=this->statements->end(); it++){
         last = (*it)->codeGen(context);
@@ -167,33 +274,29 @@ llvm::Value* NBlock::codeGen(CodeGenContext &context) {
 }
 
 llvm::Value* NInteger::codeGen(CodeGenContext &context) {
-    cout << "Generating Integer: " << this->value << endl;
+    TRACE(CodeGen, 2, "Generating Integer: " << this->value);
     return ConstantInt::get(Type::getInt32Ty(context.llvmContext), this->value, true);
 //    return ConstantInt::get(context.llvmContext, APInt(INTBITS, this->value, true));
 }
 
 llvm::Value* NDouble::codeGen(CodeGenContext &context) {
-    cout << "Generating Double: " << this->value << endl;
+    TRACE(CodeGen, 2, "Generating Double: " << this->value);
     return ConstantFP::get(Type::getDoubleTy(context.llvmContext), this->value);
 //    return ConstantFP::get(context.llvmContext, APFloat(this->value));
 }
 
 llvm::Value* NIdentifier::codeGen(CodeGenContext &context) {
-    cout << "Generating identifier " << this->name << endl;
+    TRACE(CodeGen, 2, "Generating identifier " << this->name);
     Value* value = context.getSymbolValue(this->name);
     if( !value ){
-        return LogErrorV("Unknown variable name " + this->name);
-    }
-    if( value->getType()->isPointerTy() ){
-        auto arrayPtr = context.builder.CreateLoad(value, "arrayPtr");
-        if( arrayPtr->getType()->isArrayTy() ){
-            cout << "(Array Type)" << endl;
-//            arrayPtr->setAlignment(16);
-            std::vector<Value*> indices;
-            indices.push_back(ConstantInt::get(context.typeSystem.intTy, 0, false));
-            auto ptr = context.builder.CreateInBoundsGEP(value, indices, "arrayPtr");
-            return ptr;
-        }
+        return LogErrorV("Unknown variable name " + this->name.str());
+    }
+    // an array decays to a pointer to its first element, the type array parameters take
+    if( value->getType()->getPointerElementType()->isArrayTy() ){
+        TRACE(CodeGen, 2, "(Array Type)");
+        Value* zero = ConstantInt::get(context.typeSystem.intTy, 0);
+        Value* indices[] = { zero, zero };
+        return context.builder.CreateInBoundsGEP(value, indices, "arrayDecay");
     }
     return context.builder.CreateLoad(value, false, "");
 
@@ -203,27 +306,50 @@ llvm::Value* NExpressionStatement::codeGen(CodeGenContext &context) {
     return this->expression->codeGen(context);
 }
 
+// A ref parameter points at a whole struct, so it is nonnull and
+// dereferenceable for the struct's size; a const ref is also readonly. No
+// noalias: nothing stops f(x, x) or a ref to a global the callee also uses.
+static void addReferenceAttributes(Function* function, unsigned argNo, const NIdentifier& type, CodeGenContext &context){
+    Type* structType = context.typeSystem.getVarType(type.name);
+    unsigned index = argNo + 1;         // attribute index 0 is the return value
+    function->addAttribute(index, Attribute::NonNull);
+    function->addDereferenceableAttr(index, context.theModule->getDataLayout().getTypeAllocSize(structType));
+    if( type.isConst )
+        function->addAttribute(index, Attribute::ReadOnly);
+}
+
 llvm::Value* NFunctionDeclaration::codeGen(CodeGenContext &context) {
-    cout << "Generating function declaration of " << this->id->name << endl;
+    TraceScope timeScope("CodeGen Function", this->id->name.str());
+    TRACE(CodeGen, 1, "Generating function declaration of " << this->id->name);
     std::vector<Type*> argTypes;
 
+    // array parameters and return values are decayed pointers, see TypeSystem::getVarType
     for(auto &arg: *this->arguments){
-        if( arg->type->isArray ){
-            argTypes.push_back(PointerType::get(context.typeSystem.getVarType(arg->type->name), 0));
-        } else{
-            argTypes.push_back(TypeOf(*arg->type, context));
-        }
+        argTypes.push_back(TypeOf(*arg->type, context));
     }
-    Type* retType = nullptr;
-    if( this->type->isArray )
-        retType = PointerType::get(context.typeSystem.getVarType(this->type->name), 0);
-    else
-        retType = TypeOf(*this->type, context);
+    Type* retType = TypeOf(*this->type, context);
 
     FunctionType* functionType = FunctionType::get(retType, argTypes, false);
     Function* function = Function::Create(functionType, GlobalValue::ExternalLinkage, this->id->name.c_str(), context.theModule.get());
 
+    // calls look the passing convention up here, extern declarations included
+    std::vector<ParamKind> kinds;
+    for(auto &arg: *this->arguments){
+        if( arg->type->isReference ){
+            addReferenceAttributes(function, kinds.size(), *arg->type, context);
+            kinds.push_back(arg->type->isConst ? ParamKind::ConstReference : ParamKind::Reference);
+        }else{
+            kinds.push_back(ParamKind::Value);
+        }
+    }
+    context.setParamKinds(this->id->name.str(), std::move(kinds));
+
     if( !this->isExternal ){
+        function->addFnAttr("target-cpu", context.targetCPU);
+        if( !context.targetFeatures.empty() ){
+            function->addFnAttr("target-features", context.targetFeatures);
+        }
+
         BasicBlock* basicBlock = BasicBlock::Create(context.llvmContext, "entry", function, nullptr);
 
         context.builder.SetInsertPoint(basicBlock);
@@ -233,14 +359,19 @@ llvm::Value* NFunctionDeclaration::codeGen(CodeGenContext &context) {
         auto origin_arg = this->arguments->begin();
 
         for(auto &ir_arg_it: function->args()){
-            ir_arg_it.setName((*origin_arg)->id->name);
+            ir_arg_it.setName((*origin_arg)->id->name.str());
             Value* argAlloc;
-            if( (*origin_arg)->type->isArray )
-                argAlloc = context.builder.CreateAlloca(PointerType::get(context.typeSystem.getVarType((*origin_arg)->type->name), 0));
-            else
-                argAlloc = (*origin_arg)->codeGen(context);
+            if( (*origin_arg)->type->isReference ){
+                // the argument already is the struct's address, members are reached through it directly
+                argAlloc = &ir_arg_it;
+            }else{
+                if( (*origin_arg)->type->isArray )
+                    argAlloc = context.createEntryAlloca(TypeOf(*(*origin_arg)->type, context));
+                else
+                    argAlloc = (*origin_arg)->codeGen(context);
+                context.builder.CreateStore(&ir_arg_it, argAlloc, false);
+            }
 
-            context.builder.CreateStore(&ir_arg_it, argAlloc, false);
             context.setSymbolValue((*origin_arg)->id->name, argAlloc);
             context.setSymbolType((*origin_arg)->id->name, (*origin_arg)->type);
             context.setFuncArg((*origin_arg)->id->name, true);
@@ -251,6 +382,7 @@ llvm::Value* NFunctionDeclaration::codeGen(CodeGenContext &context) {
         if( context.getCurrentReturnValue() ){
             context.builder.CreateRet(context.getCurrentReturnValue());
         } else{
+            context.popBlock();
             return LogErrorV("Function block return value not founded");
         }
         context.popBlock();
@@ -263,12 +395,12 @@ llvm::Value* NFunctionDeclaration::codeGen(CodeGenContext &context) {
 
 
 llvm::Value* NStructDeclaration::codeGen(CodeGenContext& context) {
-    cout << "Generating struct declaration of " << this->name->name << endl;
+    TRACE(CodeGen, 2, "Generating struct declaration of " << this->name->name);
 
     std::vector<Type*> memberTypes;
 
 //    context.builder.createstr
-    auto structType = StructType::create(context.llvmContext, this->name->name);
+    auto structType = StructType::create(context.llvmContext, this->name->name.str());
     context.typeSystem.addStructType(this->name->name, structType);
 
     for(auto& member: *this->members){
@@ -281,9 +413,23 @@ llvm::Value* NStructDeclaration::codeGen(CodeGenContext& context) {
     return nullptr;
 }
 
+// A ref parameter takes the address of a struct variable, never a copy
+static Value* referenceArgument(NExpression* argument, Type* paramType, bool readOnly, CodeGenContext &context){
+    auto identifier = dynamic_cast<NIdentifier*>(argument);
+    Value* address = identifier ? context.getSymbolValue(identifier->name) : nullptr;
+    if( !address || address->getType() != paramType ){
+        return LogErrorV("Reference argument must be a struct variable of the parameter's type");
+    }
+    auto type = context.getSymbolType(identifier->name);
+    if( !readOnly && type && type->isConst ){
+        return LogErrorV("Cannot pass const reference " + identifier->name.str() + " as a mutable reference");
+    }
+    return address;
+}
+
 llvm::Value* NMethodCall::codeGen(CodeGenContext &context) {
-    cout << "Generating method call of " << this->id->name << endl;
-    Function * calleeF = context.theModule->getFunction(this->id->name);
+    TRACE(CodeGen, 2, "Generating method call of " << this->id->name);
+    Function * calleeF = context.theModule->getFunction(this->id->name.str());
     if( !calleeF ){
         LogErrorV("Function name not found");
     }
@@ -292,42 +438,55 @@ llvm::Value* NMethodCall::codeGen(CodeGenContext &context) {
     }
     std::vector<Value*> argsv;
     for(auto it=this->arguments->begin(); it!=this->arguments->end(); it++){
-        argsv.push_back((*it)->codeGen(context));
+        unsigned argNo = argsv.size();
+        ParamKind kind = context.getParamKind(this->id->name.str(), argNo);
+        if( kind != ParamKind::Value && argNo < calleeF->arg_size() ){
+            Type* paramType = calleeF->getFunctionType()->getParamType(argNo);
+            argsv.push_back(referenceArgument(*it, paramType, kind == ParamKind::ConstReference, context));
+        }else{
+            argsv.push_back((*it)->codeGen(context));
+        }
         if( !argsv.back() ){        // if any argument codegen fail
             return nullptr;
         }
     }
-    return context.builder.CreateCall(calleeF, argsv, "calltmp");
+    // a void result, e.g. of tinyrt_release(), can't carry a name
+    return context.builder.CreateCall(calleeF, argsv, calleeF->getReturnType()->isVoidTy() ? "" : "calltmp");
 }
 
 llvm::Value* NVariableDeclaration::codeGen(CodeGenContext &context) {
-    cout << "Generating variable declaration of " << this->type->name << " " << this->id->name << endl;
+    TRACE(CodeGen, 2, "Generating variable declaration of " << this->type->name << " " << this->id->name);
     Type* type = TypeOf(*this->type, context);
     Value* initial = nullptr;
 
     Value* inst = nullptr;
 
     if( this->type->isArray ){
-        uint64_t arraySize = 1;
         std::vector<uint64_t> arraySizes;
         for(auto it=this->type->arraySize->begin(); it!=this->type->arraySize->end(); it++){
-            NInteger* integer = dynamic_cast<NInteger*>(it->get());
-            arraySize *= integer->value;
+            NInteger* integer = dynamic_cast<NInteger*>(*it);
             arraySizes.push_back(integer->value);
         }
 
         context.setArraySize(this->id->name, arraySizes);
-        Value* arraySizeValue = NInteger(arraySize).codeGen(context);
-        auto arrayType = ArrayType::get(context.typeSystem.getVarType(this->type->name), arraySize);
-        inst = context.builder.CreateAlloca(arrayType, arraySizeValue, "arraytmp");
+        // one nested [N x [M x T]], not N copies of it as an element count would allocate
+        auto arrayType = context.typeSystem.getArrayType(*this->type);
+        if( context.declaresGlobals() ){
+            inst = new GlobalVariable(*context.theModule, arrayType, false, GlobalValue::ExternalLinkage, Constant::getNullValue(arrayType), this->id->name.str());
+        }else{
+            inst = context.createEntryAlloca(arrayType, "arraytmp");
+        }
+    }else if( context.declaresGlobals() ){
+        inst = new GlobalVariable(*context.theModule, type, false, GlobalValue::ExternalLinkage, Constant::getNullValue(type), this->id->name.str());
     }else{
-        inst = context.builder.CreateAlloca(type);
+        inst = context.createEntryAlloca(type);
     }
 
     context.setSymbolType(this->id->name, this->type);
     context.setSymbolValue(this->id->name, inst);
 
-    context.PrintSymTable();
+    if( Trace::enabled(Trace::Symbols, 3) )
+        context.PrintSymTable();
 
     if( this->assignmentExpr != nullptr ){
         NAssignment assignment(this->id, this->assignmentExpr);
@@ -337,14 +496,14 @@ llvm::Value* NVariableDeclaration::codeGen(CodeGenContext &context) {
 }
 
 llvm::Value* NReturnStatement::codeGen(CodeGenContext &context) {
-    cout << "Generating return statement" << endl;
+    TRACE(CodeGen, 2, "Generating return statement");
     Value* returnValue = this->expression->codeGen(context);
     context.setCurrentReturnValue(returnValue);
     return returnValue;
 }
 
 llvm::Value* NIfStatement::codeGen(CodeGenContext &context) {
-    cout << "Generating if statement" << endl;
+    TRACE(CodeGen, 2, "Generating if statement");
     Value* condValue = this->condition->codeGen(context);
     if( !condValue )
         return nullptr;
@@ -396,166 +555,353 @@ llvm::Value* NIfStatement::codeGen(CodeGenContext &context) {
     return nullptr;
 }
 
+// The distinct llvm.loop node for a loop's hints; its first operand is itself
+static MDNode* loopHintMetadata(const LoopHints& hints, LLVMContext& llvmContext){
+    Type* i32 = Type::getInt32Ty(llvmContext);
+    Type* i1 = Type::getInt1Ty(llvmContext);
+    auto hint = [&llvmContext](const char* name, Constant* value) -> Metadata* {
+        Metadata* operands[] = { MDString::get(llvmContext, name), ConstantAsMetadata::get(value) };
+        return MDNode::get(llvmContext, operands);
+    };
+
+    auto self = MDNode::getTemporary(llvmContext, None);
+    SmallVector<Metadata*, 6> operands;
+    operands.push_back(self.get());
+    if( hints.vectorize ){
+        operands.push_back(hint("llvm.loop.vectorize.enable", ConstantInt::get(i1, 1)));
+        if( hints.vectorizeWidth )
+            operands.push_back(hint("llvm.loop.vectorize.width", ConstantInt::get(i32, hints.vectorizeWidth)));
+    }
+    if( hints.interleaveCount )
+        operands.push_back(hint("llvm.loop.interleave.count", ConstantInt::get(i32, hints.interleaveCount)));
+    if( hints.unroll ){
+        if( hints.unrollCount )
+            operands.push_back(hint("llvm.loop.unroll.count", ConstantInt::get(i32, hints.unrollCount)));
+        else
+            operands.push_back(MDNode::get(llvmContext, MDString::get(llvmContext, "llvm.loop.unroll.enable")));
+    }
+
+    MDNode* loopID = MDNode::get(llvmContext, operands);
+    loopID->replaceOperandWith(0, loopID);
+    return loopID;
+}
+
+// Scalar locals live directly in an alloca until mem2reg promotes them; the
+// induction variable and accumulators are among them and do carry a value
+// from one iteration to the next, so @no_alias says nothing about them.
+static bool isScalarLocal(Value* pointer){
+    return isa<AllocaInst>(pointer) && !cast<AllocaInst>(pointer)->getAllocatedType()->isArrayTy();
+}
+
+// Tag the memory accesses of the loop starting at header, i.e. every block from
+// the header to the end of the function, as free of loop-carried dependences.
+// The vectorizer needs all of them tagged, so a loop with a call, whose memory
+// effects are unknown here, is left alone. Accesses already tagged by an inner
+// loop get a list naming both loops.
+static void markParallelAccesses(BasicBlock* header, MDNode* loopID){
+    Function* theFunction = header->getParent();
+    LLVMContext& llvmContext = theFunction->getContext();
+    SmallVector<Instruction*, 32> accesses;
+    for(auto bb=header->getIterator(); bb!=theFunction->end(); bb++){
+        for(auto& instruction: *bb){
+            if( isa<CallInst>(instruction) || isa<InvokeInst>(instruction) ){
+                TRACE(CodeGen, 1, "@no_alias ignored, the loop contains a call");
+                return;
+            }
+            if( auto load = dyn_cast<LoadInst>(&instruction) ){
+                if( !isScalarLocal(load->getPointerOperand()) )
+                    accesses.push_back(load);
+            }else if( auto store = dyn_cast<StoreInst>(&instruction) ){
+                if( !isScalarLocal(store->getPointerOperand()) )
+                    accesses.push_back(store);
+            }
+        }
+    }
+
+    for(auto instruction: accesses){
+        MDNode* existing = instruction->getMetadata(LLVMContext::MD_mem_parallel_loop_access);
+        if( !existing ){
+            instruction->setMetadata(LLVMContext::MD_mem_parallel_loop_access, loopID);
+            continue;
+        }
+        // a loop ID refers to itself, anything else is already a list of loop IDs
+        SmallVector<Metadata*, 4> loops;
+        if( existing->getNumOperands() > 0 && existing->getOperand(0) == existing )
+            loops.push_back(existing);
+        else
+            loops.append(existing->op_begin(), existing->op_end());
+        loops.push_back(loopID);
+        instruction->setMetadata(LLVMContext::MD_mem_parallel_loop_access, MDNode::get(llvmContext, loops));
+    }
+}
+
+// Loops are emitted in the shape LLVM's loop passes expect:
+//
+//   preheader:  initial              (the block the loop starts in)
+//               br header
+//   header:     br condition, body, exit
+//   body:       ...                  (break: br exit, continue: br latch)
+//               br latch
+//   latch:      increment
+//               br header            (the only back edge)
+//   exit:
 llvm::Value* NForStatement::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating for statement");
 
     Function* theFunction = context.builder.GetInsertBlock()->getParent();
 
-    BasicBlock *block = BasicBlock::Create(context.llvmContext, "forloop", theFunction);
-    BasicBlock *after = BasicBlock::Create(context.llvmContext, "forcont");
+    BasicBlock *header = BasicBlock::Create(context.llvmContext, "for.cond", theFunction);
 
     // execute the initial
     if( this->initial )
         this->initial->codeGen(context);
+    context.builder.CreateBr(header);
 
+    context.builder.SetInsertPoint(header);
     Value* condValue = this->condition->codeGen(context);
     if( !condValue )
         return nullptr;
-
     condValue = CastToBoolean(context, condValue);
 
-    // fall to the block
-    context.builder.CreateCondBr(condValue, block, after);
+    // created only once nothing can fail before they are inserted into the function
+    BasicBlock *body = BasicBlock::Create(context.llvmContext, "for.body");
+    BasicBlock *latch = BasicBlock::Create(context.llvmContext, "for.inc");
+    BasicBlock *exit = BasicBlock::Create(context.llvmContext, "for.end");
+    context.builder.CreateCondBr(condValue, body, exit);
 
-    context.builder.SetInsertPoint(block);
+    theFunction->getBasicBlockList().push_back(body);
+    context.builder.SetInsertPoint(body);
 
-    context.pushBlock(block);
+    context.pushBlock(body);
+    context.pushLoop(latch, exit);
 
     this->block->codeGen(context);
 
+    context.popLoop();
     context.popBlock();
 
+    if( context.builder.GetInsertBlock()->getTerminator() == nullptr ){
+        context.builder.CreateBr(latch);
+    }
+
     // do increment
+    theFunction->getBasicBlockList().push_back(latch);
+    context.builder.SetInsertPoint(latch);
     if( this->increment ){
         this->increment->codeGen(context);
     }
+    BranchInst* backEdge = context.builder.CreateBr(header);
 
-    // execute the again or stop
-    condValue = this->condition->codeGen(context);
-    condValue = CastToBoolean(context, condValue);
-    context.builder.CreateCondBr(condValue, block, after);
+    if( !this->hints.empty() ){
+        TRACE(CodeGen, 2, "Loop hints " << this->hints.str());
+        MDNode* loopID = loopHintMetadata(this->hints, context.llvmContext);
+        backEdge->setMetadata(LLVMContext::MD_loop, loopID);
+
+        if( this->hints.noAlias ){
+            markParallelAccesses(header, loopID);
+        }
+    }
 
-    // insert the after block
-    theFunction->getBasicBlockList().push_back(after);
-    context.builder.SetInsertPoint(after);
+    // insert the exit block
+    theFunction->getBasicBlockList().push_back(exit);
+    context.builder.SetInsertPoint(exit);
 
     return nullptr;
 }
 
-llvm::Value *NStructMember::codeGen(CodeGenContext &context) {
-    cout << "Generating struct member expression of " << this->id->name << "." << this->member->name << endl;
+// Statements after a break or continue still need somewhere to go. They are
+// put in a fresh block without predecessors, which the optimiser deletes.
+static void jumpTo(CodeGenContext &context, BasicBlock* target, const char* deadName){
+    context.builder.CreateBr(target);
+    Function* theFunction = context.builder.GetInsertBlock()->getParent();
+    context.builder.SetInsertPoint(BasicBlock::Create(context.llvmContext, deadName, theFunction));
+}
+
+llvm::Value* NBreakStatement::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating break statement");
+    auto loop = context.currentLoop();
+    if( !loop )
+        return LogErrorV("break statement not within a loop");
+    jumpTo(context, loop->exit, "afterbreak");
+    return nullptr;
+}
+
+llvm::Value* NContinueStatement::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating continue statement");
+    auto loop = context.currentLoop();
+    if( !loop )
+        return LogErrorV("continue statement not within a loop");
+    jumpTo(context, loop->latch, "aftercontinue");
+    return nullptr;
+}
 
-    auto varPtr = context.getSymbolValue(this->id->name);
-    auto structPtr = context.builder.CreateLoad(varPtr, "structPtr");
-    structPtr->setAlignment(4);
+// Address of s.member. A local struct and a ref parameter are both a pointer
+// to the struct, so only the member itself is ever loaded or stored. A struct
+// pointer variable is loaded first, p.x on a struct Point* p reads (*p).x.
+static Value* structMemberPtr(const NStructMember& member, CodeGenContext &context){
+    auto varPtr = context.getSymbolValue(member.id->name);
+    if( !varPtr ){
+        return LogErrorV("Unknown variable name " + member.id->name.str());
+    }
 
-    if( !structPtr->getType()->isStructTy() ){
+    Type* structType = varPtr->getType()->getPointerElementType();
+    if( structType->isPointerTy() && structType->getPointerElementType()->isStructTy() ){
+        varPtr = context.builder.CreateLoad(varPtr, "structPtr");
+        structType = structType->getPointerElementType();
+    }
+    if( !structType->isStructTy() ){
         return LogErrorV("The variable is not struct");
     }
 
-    string structName = structPtr->getType()->getStructName().str();
-    long memberIndex = context.typeSystem.getStructMemberIndex(structName, this->member->name);
+    string structName = structType->getStructName().str();
+    long memberIndex = context.typeSystem.getStructMemberIndex(structName, member.member->name);
+
+    Value* indices[] = {
+        ConstantInt::get(context.typeSystem.intTy, 0, false),
+        ConstantInt::get(context.typeSystem.intTy, (uint64_t)memberIndex, false)
+    };
+    return context.builder.CreateInBoundsGEP(varPtr, indices, "memberPtr");
+}
+
+llvm::Value *NStructMember::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating struct member expression of " << this->id->name << "." << this->member->name);
 
-    std::vector<Value*> indices;
-    indices.push_back(ConstantInt::get(context.typeSystem.intTy, 0, false));
-    indices.push_back(ConstantInt::get(context.typeSystem.intTy, (uint64_t)memberIndex, false));
-    auto ptr = context.builder.CreateInBoundsGEP(varPtr, indices, "memberPtr");
+    auto ptr = structMemberPtr(*this, context);
+    if( !ptr )
+        return nullptr;
 
     return context.builder.CreateLoad(ptr);
 }
 
 llvm::Value* NStructAssignment::codeGen(CodeGenContext &context) {
-    cout << "Generating struct assignment of " << this->structMember->id->name << "." << this->structMember->member->name << endl;
-    auto varPtr = context.getSymbolValue(this->structMember->id->name);
-    auto structPtr = context.builder.CreateLoad(varPtr, "structPtr");
-//    auto underlyingStruct = context.builder.CreateLoad(load);
-    structPtr->setAlignment(4);
-
-    if( !structPtr->getType()->isStructTy() ){
-        return LogErrorV("The variable is not struct");
+    TRACE(CodeGen, 2, "Generating struct assignment of " << this->structMember->id->name << "." << this->structMember->member->name);
+    auto type = context.getSymbolType(this->structMember->id->name);
+    if( type && type->isConst ){
+        return LogErrorV("Cannot assign to a member of const reference " + this->structMember->id->name.str());
     }
 
-    string structName = structPtr->getType()->getStructName().str();
-    long memberIndex = context.typeSystem.getStructMemberIndex(structName, this->structMember->member->name);
+    auto ptr = structMemberPtr(*this->structMember, context);
+    if( !ptr )
+        return nullptr;
 
-    std::vector<Value*> indices;
     auto value = this->expression->codeGen(context);
-//    auto index = ;
-    indices.push_back(ConstantInt::get(context.typeSystem.intTy, 0, false));
-    indices.push_back(ConstantInt::get(context.typeSystem.intTy, (uint64_t)memberIndex, false));
+    if( !value )
+        return nullptr;
+    return context.builder.CreateStore(value, ptr);
+}
 
-    auto ptr = context.builder.CreateInBoundsGEP(varPtr, indices, "structMemberPtr");
+// Declaration of a TinyRuntime.h entry point in the module being generated
+static Function* runtimeFunction(CodeGenContext &context, const char* name, Type* result, ArrayRef<Type*> params){
+    if( Function* function = context.theModule->getFunction(name) )
+        return function;
+    return Function::Create(FunctionType::get(result, params, false), GlobalValue::ExternalLinkage, name, context.theModule.get());
+}
 
-    return context.builder.CreateStore(value, ptr);
+llvm::Value *NNewExpression::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating new expression of " << this->type->name);
+    Type* elementType = context.typeSystem.getVarType(this->type->name);
+    if( !elementType || elementType->isVoidTy() ){
+        return LogErrorV("Cannot allocate type " + this->type->name.str());
+    }
+
+    Type* sizeType = Type::getInt64Ty(context.llvmContext);
+    Value* count = ConstantInt::get(sizeType, 1);
+    if( this->count ){
+        count = this->count->codeGen(context);
+        if( !count )
+            return nullptr;
+        if( !count->getType()->isIntegerTy() ){
+            return LogErrorV("Element count of new must be an integer");
+        }
+        auto constant = dyn_cast<ConstantInt>(count);
+        if( constant && constant->isNegative() && !count->getType()->isIntegerTy(1) ){
+            return LogErrorV("Element count of new is negative");
+        }
+        // a comparison gives an i1, which counts 0 or 1 elements
+        if( count->getType()->isIntegerTy(1) )
+            count = context.builder.CreateZExt(count, sizeType, "newcount");
+        else
+            count = context.builder.CreateSExtOrTrunc(count, sizeType, "newcount");
+    }
+
+    uint64_t elementSize = context.theModule->getDataLayout().getTypeAllocSize(elementType);
+    Value* size = context.builder.CreateMul(count, ConstantInt::get(sizeType, elementSize), "newsize");
+
+    Type* bytePtr = Type::getInt8PtrTy(context.llvmContext);
+    Function* allocate = runtimeFunction(context, "tinyrt_alloc", bytePtr, { sizeType });
+    Value* memory = context.builder.CreateCall(allocate, size, "newtmp");
+    return context.builder.CreateBitCast(memory, PointerType::get(elementType, 0), "newptr");
 }
 
-llvm::Value *NArrayIndex::codeGen(CodeGenContext &context) {
-    cout << "Generating array index expression of " << this->arrayName->name << endl;
-    auto varPtr = context.getSymbolValue(this->arrayName->name);
-    auto type = context.getSymbolType(this->arrayName->name);
-    string typeStr = type->name;
-
-    assert(type->isArray);
-
-    auto value = calcArrayIndex(make_shared<NArrayIndex>(*this), context);
-    ArrayRef<Value*> indices;
-    if(context.isFuncArg(this->arrayName->name) ){
-        cout << "isFuncArg" << endl;
-        varPtr = context.builder.CreateLoad(varPtr, "actualArrayPtr");
-        indices = { value };
-    }else if( varPtr->getType()->isPointerTy() ){
-        cout << this->arrayName->name << "Not isFuncArg" << endl;
-        indices = { ConstantInt::get(Type::getInt64Ty(context.llvmContext), 0), value };
-    }else{
-        return LogErrorV("The variable is not array");
+llvm::Value *NDeleteStatement::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating delete statement");
+    Value* pointer = this->expression->codeGen(context);
+    if( !pointer )
+        return nullptr;
+    if( !pointer->getType()->isPointerTy() ){
+        return LogErrorV("delete needs a pointer");
     }
-    auto ptr = context.builder.CreateInBoundsGEP(varPtr, indices, "elementPtr");
 
-    return context.builder.CreateAlignedLoad(ptr, 4);
+    Type* bytePtr = Type::getInt8PtrTy(context.llvmContext);
+    Function* release = runtimeFunction(context, "tinyrt_free", Type::getVoidTy(context.llvmContext), { bytePtr });
+    return context.builder.CreateCall(release, context.builder.CreateBitCast(pointer, bytePtr));
 }
 
+llvm::Value *NArrayIndex::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating array index expression of " << this->arrayName->name);
+    auto ptr = arrayElementPtr(*this, context);
+    if( !ptr )
+        return nullptr;
 
-llvm::Value *NArrayAssignment::codeGen(CodeGenContext &context) {
-    cout << "Generating array index assignment of " << this->arrayIndex->arrayName->name << endl;
-    auto varPtr = context.getSymbolValue(this->arrayIndex->arrayName->name);
+    return context.builder.CreateAlignedLoad(ptr, 4);
+}
 
-    if( varPtr == nullptr ){
-        return LogErrorV("Unknown variable name");
-    }
-    
-    auto arrayPtr = context.builder.CreateLoad(varPtr, "arrayPtr");
-//    arrayPtr->setAlignment(16);
 
-    if( !arrayPtr->getType()->isArrayTy() && !arrayPtr->getType()->isPointerTy() ){
-        return LogErrorV("The variable is not array");
-    }
-//    std::vector<Value*> indices;
-    auto index = calcArrayIndex(arrayIndex, context);
-//    cout << "here2" << endl;
-    ArrayRef<Value*> gep2_array{ ConstantInt::get(Type::getInt64Ty(context.llvmContext), 0), index };
-    auto ptr = context.builder.CreateInBoundsGEP(varPtr, gep2_array, "elementPtr");
+llvm::Value *NArrayAssignment::codeGen(CodeGenContext &context) {
+    TRACE(CodeGen, 2, "Generating array index assignment of " << this->arrayIndex->arrayName->name);
+    auto ptr = arrayElementPtr(*this->arrayIndex, context);
+    if( !ptr )
+        return nullptr;
 
-    return context.builder.CreateAlignedStore(this->expression->codeGen(context), ptr, 4);
+    auto value = this->expression->codeGen(context);
+    if( !value )
+        return nullptr;
+    return context.builder.CreateAlignedStore(value, ptr, 4);
 }
 
 llvm::Value *NArrayInitialization::codeGen(CodeGenContext &context) {
-    cout << "Generating array initialization of " << this->declaration->id->name << endl;
+    TRACE(CodeGen, 2, "Generating array initialization of " << this->declaration->id->name);
     auto arrayPtr = this->declaration->codeGen(context);
     auto sizeVec = context.getArraySize(this->declaration->id->name);
-    // TODO: multi-dimension array initialization
-    assert(sizeVec.size() == 1);
+    uint64_t elementCount = 1;
+    for(auto size: sizeVec){
+        elementCount *= size;
+    }
+    if( sizeVec.empty() || this->expressionList->size() > elementCount ){
+        return LogErrorV("Too many initializers for array " + this->declaration->id->name.str());
+    }
 
-    for(int index=0; index < this->expressionList->size(); index++){
-        shared_ptr<NInteger> indexValue = make_shared<NInteger>(index);
+    // the list fills the array in row-major order, [1, 2, 3, 4] is {{1, 2}, {3, 4}} for a[2][2]
+    SmallVector<Value*, 4> indices(sizeVec.size() + 1);
+    indices[0] = ConstantInt::get(context.typeSystem.intTy, 0);
+    for(uint64_t element=0; element < this->expressionList->size(); element++){
+        auto value = this->expressionList->at(element)->codeGen(context);
+        if( !value )
+            return nullptr;
 
-        shared_ptr<NArrayIndex> arrayIndex = make_shared<NArrayIndex>(this->declaration->id, indexValue);
-        NArrayAssignment assignment(arrayIndex, this->expressionList->at(index));
-        assignment.codeGen(context);
+        uint64_t rest = element;
+        for(size_t dimension=sizeVec.size(); dimension-- > 0; ){
+            indices[dimension + 1] = ConstantInt::get(context.typeSystem.intTy, rest % sizeVec[dimension]);
+            rest /= sizeVec[dimension];
+        }
+        auto ptr = context.builder.CreateInBoundsGEP(arrayPtr, indices, "elementPtr");
+        context.builder.CreateAlignedStore(value, ptr, 4);
     }
     return nullptr;
 }
 
 llvm::Value *NLiteral::codeGen(CodeGenContext &context) {
-    return context.builder.CreateGlobalString(this->value, "string");
+    return context.builder.CreateGlobalString(this->value.str(), "string");
 }
 
 /*
@@ -6,7 +6,6 @@
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
-#include <json/json.h>
 
 #include <stack>
 #include <vector>
@@ -16,6 +15,7 @@
 #include "ASTNodes.h"
 #include "grammar.hpp"
 #include "TypeSystem.h"
+#include "Trace.h"
 
 using namespace llvm;
 using std::unique_ptr;
@@ -23,19 +23,97 @@ using std::string;
 
 using SymTable = std::map<string, Value*>;
 
+// Everything codegen knows about one declaration of a name
+struct SymbolRecord{
+    Symbol name;
+    Value* value = nullptr;
+    NIdentifier* type = nullptr;
+    std::vector<uint64_t> arraySizes;
+    bool isFuncArg = false;
+    int32_t shadowed = -1;          // record of the same name in an outer scope
+};
+
+// All scopes in one table. Records are stacked in declaration order and
+// _innermost maps a SymbolID straight to the record in scope, so a lookup is
+// one array index whatever the nesting depth. A scope is a mark into the
+// record stack; popping it truncates the stack and points each name back at
+// the record it shadowed. IDs must all come from the same SymbolPool.
+class SymbolTable{
+private:
+    std::vector<SymbolRecord> _records;
+    std::vector<int32_t> _innermost;        // SymbolID -> record index, -1 when not in scope
+
+public:
+    SymbolRecord* lookup(SymbolID id){
+        if( id >= _innermost.size() || _innermost[id] < 0 )
+            return nullptr;
+        return &_records[_innermost[id]];
+    }
+
+    // The record for name in the scope starting at scopeMark, created on first use.
+    // Pointers and references into the table are invalidated by the next declare.
+    SymbolRecord& declare(Symbol name, size_t scopeMark){
+        SymbolID id = name.id();
+        if( id >= _innermost.size() )
+            _innermost.resize(id + 1, -1);
+        if( _innermost[id] >= 0 && (size_t)_innermost[id] >= scopeMark )
+            return _records[_innermost[id]];
+
+        _records.push_back(SymbolRecord());
+        SymbolRecord& record = _records.back();
+        record.name = name;
+        record.shadowed = _innermost[id];
+        _innermost[id] = (int32_t)(_records.size() - 1);
+        return record;
+    }
+
+    size_t mark() const{
+        return _records.size();
+    }
+
+    void popTo(size_t scopeMark){
+        while( _records.size() > scopeMark ){
+            _innermost[_records.back().name.id()] = _records.back().shadowed;
+            _records.pop_back();
+        }
+    }
+
+    const std::vector<SymbolRecord>& records() const{
+        return _records;
+    }
+};
+
 class CodeGenBlock{
 public:
     BasicBlock * block;
     Value * returnValue;
-    std::map<string, Value*> locals;
-    std::map<string, shared_ptr<NIdentifier>> types;     // type name string of vars
-    std::map<string, bool> isFuncArg;
-    std::map<string, std::vector<uint64_t>> arraySizes;
+    size_t scopeMark;           // first symbol record declared in this block
+};
+
+// How a function parameter is passed, as its declaration says
+enum class ParamKind{
+    Value,
+    Reference,          // ref struct T, the caller passes the struct's address
+    ConstReference
+};
+
+// Where break and continue go in the loop being generated
+class CodeGenLoop{
+public:
+    BasicBlock * latch;         // continue: increment, then back to the header
+    BasicBlock * exit;          // break
 };
 
 class CodeGenContext{
 private:
-    std::vector<CodeGenBlock*> blockStack;
+    std::vector<CodeGenBlock> blockStack;
+    std::vector<CodeGenLoop> loopStack;
+    std::map<string, std::vector<ParamKind>> paramKinds;     // by function name, outlives modules in the REPL
+    SymbolTable symbols;
+
+    SymbolRecord& declare(Symbol name){
+        return symbols.declare(name, blockStack.back().scopeMark);
+    }
 
 public:
     LLVMContext llvmContext;
@@ -43,109 +121,133 @@ public:
     unique_ptr<Module> theModule;
     SymTable globalVars;
     TypeSystem typeSystem;
+    bool printIR = true;        // dump the module to stdout after generating it
+    string targetCPU = "generic";   // recorded on every function so the optimiser sees the real ISA
+    string targetFeatures;
+    bool topLevelGlobals = false;   // REPL: variables declared outside any function become module globals
 
     CodeGenContext(): builder(llvmContext), typeSystem(llvmContext){
         theModule = unique_ptr<Module>(new Module("main", this->llvmContext));
     }
 
-    Value* getSymbolValue(string name) const{
-        for(auto it=blockStack.rbegin(); it!=blockStack.rend(); it++){
-//            cout << "(*it)->locals[" << name << "] = " << (*it)->locals[name] << endl;
-            if( (*it)->locals.find(name) != (*it)->locals.end() ){
-                return (*it)->locals[name];
-            }
-        }
-        return nullptr;
+    Value* getSymbolValue(Symbol name){
+        auto record = symbols.lookup(name.id());
+        return record ? record->value : nullptr;
     }
 
-    shared_ptr<NIdentifier> getSymbolType(string name) const{
-        for(auto it=blockStack.rbegin(); it!=blockStack.rend(); it++){
-//            cout << "(*it)->locals[" << name << "] = " << (*it)->locals[name] << endl;
-            if( (*it)->types.find(name) != (*it)->types.end() ){
-                return (*it)->types[name];
-            }
-        }
-        return nullptr;
+    NIdentifier* getSymbolType(Symbol name){
+        auto record = symbols.lookup(name.id());
+        return record ? record->type : nullptr;
     }
 
-    bool isFuncArg(string name) const{
+    bool isFuncArg(Symbol name){
+        auto record = symbols.lookup(name.id());
+        return record ? record->isFuncArg : false;
+    }
 
-        for(auto it=blockStack.rbegin(); it!=blockStack.rend(); it++){
-            if( (*it)->isFuncArg.find(name) != (*it)->isFuncArg.end() ){
-                return (*it)->isFuncArg[name];
-            }
-        }
-        return false;
+    void setSymbolValue(Symbol name, Value* value){
+        declare(name).value = value;
     }
 
-    void setSymbolValue(string name, Value* value){
-        blockStack.back()->locals[name] = value;
+    void setSymbolType(Symbol name, NIdentifier* value){
+        declare(name).type = value;
     }
 
-    void setSymbolType(string name, shared_ptr<NIdentifier> value){
-        blockStack.back()->types[name] = value;
+    void setFuncArg(Symbol name, bool value){
+        TRACE(Symbols, 2, "Set " << name << " as func arg");
+        declare(name).isFuncArg = value;
     }
 
-    void setFuncArg(string name, bool value){
-        cout << "Set " << name << " as func arg" << endl;
-        blockStack.back()->isFuncArg[name] = value;
+    bool declaresGlobals() const{
+        return topLevelGlobals && blockStack.size() == 1;
     }
 
     BasicBlock* currentBlock() const{
-        return blockStack.back()->block;
+        return blockStack.back().block;
     }
 
     void pushBlock(BasicBlock * block){
-        CodeGenBlock * codeGenBlock = new CodeGenBlock();
-        codeGenBlock->block = block;
-        codeGenBlock->returnValue = nullptr;
-        blockStack.push_back(codeGenBlock);
+        blockStack.push_back(CodeGenBlock{block, nullptr, symbols.mark()});
     }
 
     void popBlock(){
-        CodeGenBlock * codeGenBlock = blockStack.back();
+        symbols.popTo(blockStack.back().scopeMark);
         blockStack.pop_back();
-        delete codeGenBlock;
+    }
+
+    void setParamKinds(const string& function, std::vector<ParamKind> kinds){
+        paramKinds[function] = std::move(kinds);
+    }
+
+    ParamKind getParamKind(const string& function, size_t argNo) const{
+        auto it = paramKinds.find(function);
+        if( it == paramKinds.end() || argNo >= it->second.size() )
+            return ParamKind::Value;
+        return it->second[argNo];
+    }
+
+    // The REPL restores these when it throws an input away
+    std::map<string, std::vector<ParamKind>> savedParamKinds() const{
+        return paramKinds;
+    }
+
+    void restoreParamKinds(std::map<string, std::vector<ParamKind>> kinds){
+        paramKinds = std::move(kinds);
+    }
+
+    void pushLoop(BasicBlock* latch, BasicBlock* exit){
+        loopStack.push_back(CodeGenLoop{latch, exit});
+    }
+
+    void popLoop(){
+        loopStack.pop_back();
+    }
+
+    // The innermost loop, nullptr outside of any loop
+    const CodeGenLoop* currentLoop() const{
+        return loopStack.empty() ? nullptr : &loopStack.back();
     }
 
     void setCurrentReturnValue(Value* value){
-        blockStack.back()->returnValue = value;
+        blockStack.back().returnValue = value;
     }
 
     Value* getCurrentReturnValue(){
-        return blockStack.back()->returnValue;
+        return blockStack.back().returnValue;
     }
 
-    void setArraySize(string name, std::vector<uint64_t> value){
-        cout << "setArraySize: " << name << ": " << value.size() << endl;
-        blockStack.back()->arraySizes[name] = value;
-//        cout << "blockStack.back()->arraySizes.size()" << blockStack.back()->arraySizes.size() << endl;
+    void setArraySize(Symbol name, std::vector<uint64_t> value){
+        TRACE(Symbols, 2, "setArraySize: " << name << ": " << value.size());
+        declare(name).arraySizes = std::move(value);
     }
 
-    std::vector<uint64_t> getArraySize(string name){
-        for(auto it=blockStack.rbegin(); it!=blockStack.rend(); it++){
-            if( (*it)->arraySizes.find(name) != (*it)->arraySizes.end() ){
-                return (*it)->arraySizes[name];
-            }
-        }
-        return blockStack.back()->arraySizes[name];
+    std::vector<uint64_t> getArraySize(Symbol name){
+        auto record = symbols.lookup(name.id());
+        return record ? record->arraySizes : std::vector<uint64_t>();
     }
 
     void PrintSymTable() const{
-        cout << "======= Print Symbol Table ========" << endl;
+        TRACE(Symbols, 1, "======= Print Symbol Table ========");
         string prefix = "";
-        for(auto it=blockStack.begin(); it!=blockStack.end(); it++){
-            for(auto it2=(*it)->locals.begin(); it2!=(*it)->locals.end(); it2++){
-                cout << prefix << it2->first << " = " << it2->second << ": " << this->getSymbolType(it2->first) << endl;
+        auto& records = symbols.records();
+        for(size_t i=0; i<blockStack.size(); i++){
+            size_t end = i + 1 < blockStack.size() ? blockStack[i + 1].scopeMark : records.size();
+            for(size_t j=blockStack[i].scopeMark; j<end; j++){
+                TRACE(Symbols, 1, prefix << records[j].name << " = " << records[j].value << ": " << records[j].type);
             }
             prefix += "\t";
         }
-        cout << "===================================" << endl;
+        TRACE(Symbols, 1, "===================================");
     }
 
+    // Allocas in the entry block run once per call no matter where the variable
+    // is declared, and are the ones mem2reg/SROA can promote to registers.
+    AllocaInst* createEntryAlloca(Type* type, const Twine& name = "");
+
     void generateCode(NBlock& );
 };
 
+Type* TypeOf(const NIdentifier& type, CodeGenContext& context);
 Value* LogErrorV(const char* str);
 Value* LogErrorV(string str);
 
@@ -0,0 +1,103 @@
+//
+// On-disk cache of object files keyed by everything that affects codegen.
+//
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdlib>
+
+#include "CompileCache.h"
+#include "Driver.h"
+#include "SourceBuffer.h"
+
+using namespace llvm;
+
+static bool copyFile(StringRef from, StringRef to){
+    auto buffer = MemoryBuffer::getFile(from);
+    if( !buffer )
+        return false;
+
+    std::error_code EC;
+    raw_fd_ostream dest(to, EC, sys::fs::F_None);
+    if( EC )
+        return false;
+    dest << (*buffer)->getBuffer();
+    dest.close();
+    return !dest.has_error();
+}
+
+// length-prefixed so adjacent fields can't run into each other
+static void hashField(MD5& hash, StringRef field){
+    uint64_t length = field.size();
+    hash.update(ArrayRef<uint8_t>((const uint8_t*)&length, sizeof(length)));
+    hash.update(field);
+}
+
+CompileCache::CompileCache(const std::string &directory): _directory(directory) {
+    sys::fs::create_directories(_directory);
+}
+
+std::string CompileCache::directoryFor(const DriverOptions &options) {
+    if( !options.cacheDir.empty() )
+        return options.cacheDir;
+    const char* env = getenv("TINYCOMPILER_CACHE_DIR");
+    return env ? env : "";
+}
+
+std::string CompileCache::key(const std::vector<std::unique_ptr<SourceBuffer>> &sources, const DriverOptions &options) {
+    MD5 hash;
+    hashField(hash, TINYCOMPILER_VERSION);
+    hashField(hash, LLVM_VERSION_STRING);
+    hashField(hash, options.triple.empty() ? sys::getDefaultTargetTriple() : options.triple);
+    hashField(hash, options.cpu);
+    hashField(hash, options.features);
+    hashField(hash, std::to_string(options.optLevel));
+    hashField(hash, options.fold ? "fold" : "no-fold");
+    for(auto& source: sources){
+        hashField(hash, StringRef(source->data(), source->size()));
+    }
+
+    MD5::MD5Result result;
+    hash.final(result);
+    SmallString<32> digest;
+    MD5::stringifyResult(result, digest);
+    return digest.str().str();
+}
+
+bool CompileCache::fetch(const std::string &key, const std::string &output) const {
+    SmallString<128> entry(_directory);
+    sys::path::append(entry, key + ".o");
+    if( !sys::fs::exists(entry) )
+        return false;
+    return copyFile(entry.str(), output);
+}
+
+void CompileCache::store(const std::string &key, const std::string &objectFile) const {
+    SmallString<128> model(_directory);
+    sys::path::append(model, key + "-%%%%%%%%.tmp");
+
+    int fd;
+    SmallString<128> tempPath;
+    if( sys::fs::createUniqueFile(model, fd, tempPath) )
+        return;
+
+    auto buffer = MemoryBuffer::getFile(objectFile);
+    {
+        raw_fd_ostream temp(fd, true);
+        if( buffer )
+            temp << (*buffer)->getBuffer();
+    }
+
+    SmallString<128> entry(_directory);
+    sys::path::append(entry, key + ".o");
+    if( !buffer || sys::fs::rename(tempPath, entry) ){
+        sys::fs::remove(tempPath);
+    }
+}
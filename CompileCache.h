@@ -0,0 +1,45 @@
+//
+// On-disk cache of object files keyed by everything that affects codegen.
+//
+
+#ifndef TINYCOMPILER_COMPILECACHE_H
+#define TINYCOMPILER_COMPILECACHE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// The build passes a hash of the compiler sources, so every change to the
+// compiler invalidates old entries; a build that does not falls back to the
+// time CompileCache.cpp was compiled.
+#ifndef TINYCOMPILER_VERSION
+#define TINYCOMPILER_VERSION __DATE__ " " __TIME__
+#endif
+
+class SourceBuffer;
+struct DriverOptions;
+
+// Entries are named by an MD5 of the compiler and LLVM versions, the target
+// triple, CPU, features, optimisation level and the source text, so a hit can
+// be copied out without parsing or running LLVM at all. Entries are published
+// with an atomic rename, which keeps concurrent batch workers from seeing
+// partially written objects.
+class CompileCache{
+private:
+    std::string _directory;
+
+public:
+    explicit CompileCache(const std::string& directory);
+
+    // Directory from --cache-dir, else $TINYCOMPILER_CACHE_DIR; empty when disabled
+    static std::string directoryFor(const DriverOptions& options);
+
+    static std::string key(const std::vector<std::unique_ptr<SourceBuffer>>& sources, const DriverOptions& options);
+
+    // Copy the cached object for key to output, returns false on a miss
+    bool fetch(const std::string& key, const std::string& output) const;
+
+    void store(const std::string& key, const std::string& objectFile) const;
+};
+
+#endif //TINYCOMPILER_COMPILECACHE_H
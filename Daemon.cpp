@@ -0,0 +1,205 @@
+//
+// Long-lived compile server answering tinyc clients over a Unix socket.
+//
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ASTSimplifier.h"
+#include "CodeGen.h"
+#include "Daemon.h"
+#include "ObjGen.h"
+#include "ParseContext.h"
+#include "Protocol.h"
+#include "ThreadPool.h"
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int){
+    stopRequested = 1;
+}
+
+static void respond(int fd, bool success, const std::string& message, const char* object = nullptr, size_t size = 0){
+    writeFrame(fd, success ? "0" : "1") && writeFrame(fd, message) && writeFrame(fd, object, size);
+}
+
+// Read one request and answer it; the connection is closed by the caller
+static void serve(int fd){
+    std::string magic, args, countText;
+    if( !readFrame(fd, magic) || magic != TINYCOMPILER_PROTOCOL_MAGIC ){
+        respond(fd, false, "protocol mismatch, is tinyc from the same build?\n");
+        return;
+    }
+    if( !readFrame(fd, args) || !readFrame(fd, countText) ){
+        respond(fd, false, "truncated request\n");
+        return;
+    }
+
+    // reuse the command line parser on the forwarded options
+    std::vector<char*> argv{ const_cast<char*>("tinyc") };
+    for(size_t start=0; start<args.size(); ){
+        argv.push_back(&args[start]);
+        start = args.find('\0', start);
+        start = start == std::string::npos ? args.size() : start + 1;
+    }
+    DriverOptions options;
+    if( !parseDriverOptions((int)argv.size(), argv.data(), options) ){
+        respond(fd, false, "invalid options\n");
+        return;
+    }
+    if( options.batch || options.run || options.repl || options.daemon || !options.inputs.empty() ){
+        respond(fd, false, "only code generation options can be sent to the daemon\n");
+        return;
+    }
+    // these would act on the daemon's own process and files, not the client's
+    if( options.jobs || !options.cacheDir.empty() || options.timeTrace || !options.trace.empty()
+        || options.astDump || !options.astJson.empty() || !options.emitAST.empty() ){
+        respond(fd, false, "the daemon takes only -O, --mcpu, --mattr, --mtriple and --no-fold\n");
+        return;
+    }
+
+    // one warm context per worker, the AST of the last request is dropped here
+    static thread_local ParseContext parseContext;
+    parseContext.reset();
+
+    unsigned long count = strtoul(countText.c_str(), nullptr, 10);
+    for(unsigned long i=0; i<count; i++){
+        std::string name, text;
+        if( !readFrame(fd, name) || !readFrame(fd, text) ){
+            respond(fd, false, "truncated request\n");
+            return;
+        }
+        if( !parseContext.parse(text, name) ){
+            respond(fd, false, "Failed to parse " + name + "\n");
+            return;
+        }
+    }
+    if( !parseContext.programBlock ){
+        respond(fd, false, "no input\n");
+        return;
+    }
+
+    if( options.fold )
+        ASTSimplifier(parseContext.arena).run(*parseContext.programBlock);
+
+    CodeGenContext context;
+    context.printIR = false;
+    context.targetCPU = options.cpu;
+    context.targetFeatures = options.features;
+    context.generateCode(*parseContext.programBlock);
+
+    SmallVector<char, 0> object;
+    raw_svector_ostream stream(object);
+    if( !ObjGen(context, stream, options.cpu, options.features, options.optLevel, options.triple) ){
+        respond(fd, false, "code generation failed\n");
+        return;
+    }
+    respond(fd, true, "", object.data(), object.size());
+}
+
+// Remove a socket left behind by a daemon that died. Anything else at the
+// path, or a socket something still answers on, is left alone and refused.
+static bool removeStaleSocket(const std::string& path, const sockaddr_un& address){
+    struct stat info;
+    if( lstat(path.c_str(), &info) < 0 ){
+        if( errno == ENOENT )
+            return true;
+        perror(path.c_str());
+        return false;
+    }
+    if( !S_ISSOCK(info.st_mode) ){
+        fprintf(stderr, "%s exists and is not a socket, refusing to replace it\n", path.c_str());
+        return false;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( probe < 0 ){
+        perror("socket");
+        return false;
+    }
+    bool live = connect(probe, (const sockaddr*)&address, sizeof(address)) == 0 || errno != ECONNREFUSED;
+    close(probe);
+    if( live ){
+        fprintf(stderr, "%s is in use, is another daemon running?\n", path.c_str());
+        return false;
+    }
+    if( unlink(path.c_str()) < 0 ){
+        perror(path.c_str());
+        return false;
+    }
+    return true;
+}
+
+int runDaemon(const DriverOptions &options) {
+    std::string path = options.socketPath.empty() ? defaultSocketPath() : options.socketPath;
+    if( path.empty() )
+        return 1;
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if( path.size() >= sizeof(address.sun_path) ){
+        fprintf(stderr, "Socket path %s is too long\n", path.c_str());
+        return 1;
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( listener < 0 ){
+        perror("socket");
+        return 1;
+    }
+    if( !removeStaleSocket(path, address) ){
+        close(listener);
+        return 1;
+    }
+    if( bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 64) < 0 ){
+        perror(path.c_str());
+        close(listener);
+        return 1;
+    }
+
+    // no SA_RESTART, so a signal breaks accept() out of its wait
+    struct sigaction stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = requestStop;
+    sigaction(SIGINT, &stop, nullptr);
+    sigaction(SIGTERM, &stop, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    initializeTargets(options.triple);
+    fprintf(stderr, "Listening on %s\n", path.c_str());
+
+    {
+        ThreadPool pool(options.jobs);
+        while( !stopRequested ){
+            int connection = accept(listener, nullptr, nullptr);
+            if( connection < 0 ){
+                if( errno == EINTR || errno == ECONNABORTED )
+                    continue;
+                perror("accept");
+                break;
+            }
+            pool.async([connection]{
+                serve(connection);
+                close(connection);
+            });
+        }
+        pool.wait();
+    }
+
+    close(listener);
+    unlink(path.c_str());
+    fprintf(stderr, "Daemon on %s stopped\n", path.c_str());
+    return 0;
+}
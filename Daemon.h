@@ -0,0 +1,16 @@
+//
+// Long-lived compile server answering tinyc clients over a Unix socket.
+//
+
+#ifndef TINYCOMPILER_DAEMON_H
+#define TINYCOMPILER_DAEMON_H
+
+#include "Driver.h"
+
+// Listen on options.socketPath (or defaultSocketPath()) and serve requests on
+// a thread pool of options.jobs workers until SIGINT or SIGTERM. Targets are
+// registered once up front, and each worker keeps its ParseContext between
+// requests so the scanner and the arena's first slab are reused.
+int runDaemon(const DriverOptions& options);
+
+#endif //TINYCOMPILER_DAEMON_H
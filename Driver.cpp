@@ -0,0 +1,198 @@
+//
+// Compilation pipeline shared by the single-program and batch front ends.
+//
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "ASTSimplifier.h"
+#include "CodeGen.h"
+#include "CompileCache.h"
+#include "Driver.h"
+#include "ObjGen.h"
+#include "ParseContext.h"
+#include "Protocol.h"
+#include "SourceBuffer.h"
+#include "ThreadPool.h"
+#include "TimeTrace.h"
+
+static bool readInputList(const std::string& path, std::vector<std::string>& inputs){
+    std::ifstream list(path);
+    if( !list.is_open() ){
+        fprintf(stderr, "Can't open input list %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    while( std::getline(list, line) ){
+        if( !line.empty() && line.back() == '\r' )
+            line.pop_back();
+        if( !line.empty() )
+            inputs.push_back(line);
+    }
+    return true;
+}
+
+bool parseDriverOptions(int argc, char **argv, DriverOptions &options) {
+    for(int i=1; i<argc; i++){
+        string arg = argv[i];
+        const char* value = optionValueName(arg);
+        if( value && i + 1 >= argc ){
+            fprintf(stderr, "%s expects %s\n", arg.c_str(), value);
+            return false;
+        }
+
+        if( arg == "--batch" ){
+            options.batch = true;
+        }else if( arg == "--run" ){
+            options.run = true;
+        }else if( arg == "--repl" ){
+            options.repl = true;
+        }else if( arg == "--daemon" ){
+            options.daemon = true;
+        }else if( arg == "--socket" ){
+            options.socketPath = argv[++i];
+        }else if( arg == "-j" ){
+            options.jobs = (unsigned)atoi(argv[++i]);
+        }else if( arg.compare(0, 2, "-j") == 0 ){
+            options.jobs = (unsigned)atoi(arg.c_str() + 2);
+        }else if( arg == "-o" ){
+            options.output = argv[++i];
+        }else if( arg == "--cache-dir" ){
+            options.cacheDir = argv[++i];
+        }else if( arg == "--no-fold" ){
+            options.fold = false;
+        }else if( arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3' ){
+            options.optLevel = (unsigned)(arg[2] - '0');
+        }else if( arg == "--mcpu" || arg == "--mattr" || arg == "--mtriple" ){
+            (arg == "--mcpu" ? options.cpu : arg == "--mattr" ? options.features : options.triple) = argv[++i];
+        }else if( arg.compare(0, 7, "--mcpu=") == 0 ){
+            options.cpu = arg.substr(7);
+        }else if( arg.compare(0, 8, "--mattr=") == 0 ){
+            options.features = arg.substr(8);
+        }else if( arg.compare(0, 10, "--mtriple=") == 0 ){
+            options.triple = arg.substr(10);
+        }else if( arg == "--time-trace" ){
+            options.timeTrace = true;
+        }else if( arg.compare(0, 13, "--time-trace=") == 0 ){
+            options.timeTrace = true;
+            options.timeTraceFile = arg.substr(13);
+        }else if( arg == "--ast-dump" ){
+            options.astDump = true;
+        }else if( arg == "--ast-json" ){
+            options.astJson = "visualization/A_tree.json";
+        }else if( arg.compare(0, 11, "--ast-json=") == 0 ){
+            options.astJson = arg.substr(11);
+        }else if( arg.compare(0, 11, "--emit-ast=") == 0 ){
+            options.emitAST = arg.substr(11);
+        }else if( arg == "--trace" ){
+            options.trace = "all";
+        }else if( arg.compare(0, 8, "--trace=") == 0 ){
+            options.trace = arg.substr(8);
+        }else if( arg[0] == '@' ){
+            if( !readInputList(arg.substr(1), options.inputs) )
+                return false;
+        }else if( arg[0] == '-' && arg.size() > 1 ){
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }else{
+            options.inputs.push_back(arg);
+        }
+    }
+    if( options.batch && options.inputs.empty() ){
+        fprintf(stderr, "--batch needs at least one input\n");
+        return false;
+    }
+    if( (int)options.batch + (int)options.run + (int)options.repl + (int)options.daemon > 1 ){
+        fprintf(stderr, "--batch, --run, --repl and --daemon are exclusive\n");
+        return false;
+    }
+    if( (options.run || options.repl) && !options.triple.empty() ){
+        fprintf(stderr, "the JIT always targets the host, drop --mtriple\n");
+        return false;
+    }
+    resolveNativeTarget(options.cpu, options.features);
+    return true;
+}
+
+std::string objectFileFor(const std::string &input) {
+    auto slash = input.find_last_of('/');
+    auto dot = input.find_last_of('.');
+    if( dot == std::string::npos || (slash != std::string::npos && dot < slash) )
+        return input + ".o";
+    return input.substr(0, dot) + ".o";
+}
+
+std::string timeTraceFileFor(const DriverOptions &options) {
+    if( !options.timeTraceFile.empty() )
+        return options.timeTraceFile;
+    std::string object = objectFileFor(options.output);
+    return object.substr(0, object.size() - 2) + ".json";
+}
+
+bool openSources(const std::vector<std::string> &inputs, std::vector<std::unique_ptr<SourceBuffer>> &sources) {
+    for(auto& input: inputs){
+        auto source = SourceBuffer::open(input);
+        if( !source )
+            return false;
+        sources.push_back(std::move(source));
+    }
+    return true;
+}
+
+bool compileFile(const std::string &input, const std::string &output, const DriverOptions& options) {
+    TraceScope timeScope("Compile", input);
+    std::vector<std::unique_ptr<SourceBuffer>> sources;
+    if( !openSources({input}, sources) )
+        return false;
+
+    std::string cacheDir = CompileCache::directoryFor(options);
+    std::string cacheKey;
+    if( !cacheDir.empty() ){
+        cacheKey = CompileCache::key(sources, options);
+        if( CompileCache(cacheDir).fetch(cacheKey, output) )
+            return true;
+    }
+
+    ParseContext parseContext;
+    if( !parseContext.parse(*sources.front()) ){
+        fprintf(stderr, "Failed to parse %s\n", input.c_str());
+        return false;
+    }
+    sources.clear();
+    if( options.fold )
+        ASTSimplifier(parseContext.arena).run(*parseContext.programBlock);
+
+    CodeGenContext context;
+    context.printIR = false;
+    context.targetCPU = options.cpu;
+    context.targetFeatures = options.features;
+    context.generateCode(*parseContext.programBlock);
+    if( !ObjGen(context, output, options.cpu, options.features, options.optLevel, options.triple) )
+        return false;
+
+    if( !cacheDir.empty() )
+        CompileCache(cacheDir).store(cacheKey, output);
+    return true;
+}
+
+int compileBatch(const DriverOptions &options) {
+    std::atomic<int> failures(0);
+    {
+        ThreadPool pool(options.jobs);
+        for(auto& input: options.inputs){
+            pool.async([&input, &failures, &options]{
+                if( !compileFile(input, objectFileFor(input), options) ){
+                    fprintf(stderr, "Failed to compile %s\n", input.c_str());
+                    failures++;
+                }
+            });
+        }
+        pool.wait();
+    }
+    fprintf(stderr, "Compiled %zu of %zu inputs\n", options.inputs.size() - failures, options.inputs.size());
+    return failures;
+}
@@ -0,0 +1,61 @@
+//
+// Compilation pipeline shared by the single-program and batch front ends.
+//
+
+#ifndef TINYCOMPILER_DRIVER_H
+#define TINYCOMPILER_DRIVER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class SourceBuffer;
+
+struct DriverOptions{
+    std::vector<std::string> inputs;
+    std::string output = "output.o";
+    bool batch = false;
+    bool run = false;               // JIT the program and call its main instead of emitting an object
+    bool repl = false;              // interactive loop, inputs are loaded first
+    bool daemon = false;            // serve tinyc clients, see Daemon.h
+    std::string socketPath;         // --socket, defaults to defaultSocketPath()
+    unsigned jobs = 0;              // batch worker threads, 0 = hardware threads
+    std::string cacheDir;           // object cache, see CompileCache
+    bool timeTrace = false;
+    std::string timeTraceFile;      // defaults to the output name with .json
+    std::string trace;              // --trace=SPEC, see Trace::configure
+    bool astDump = false;           // print the AST to stdout
+    std::string astJson;            // --ast-json[=FILE], empty when not exporting
+    std::string emitAST;            // --emit-ast=FILE, binary AST for reloading, see ASTSerializer.h
+
+    // target description handed to ObjGen, also part of the cache key;
+    // "native" is resolved to the host CPU and features while parsing options
+    std::string cpu = "generic";        // --mcpu
+    std::string features;               // --mattr, e.g. +avx2,+fma
+    std::string triple;                 // --mtriple, empty for the host
+    unsigned optLevel = 0;          // -O0 .. -O3
+    bool fold = true;               // run ASTSimplifier before codegen, --no-fold turns it off
+};
+
+// Parse argv into options. Arguments starting with '@' name a file listing
+// one input path per line. Returns false on a usage error.
+bool parseDriverOptions(int argc, char** argv, DriverOptions& options);
+
+// foo/bar.input -> foo/bar.o
+std::string objectFileFor(const std::string& input);
+
+// --time-trace=FILE, or output.o -> output.json
+std::string timeTraceFileFor(const DriverOptions& options);
+
+// Map every input, returns false if any of them can't be opened
+bool openSources(const std::vector<std::string>& inputs, std::vector<std::unique_ptr<SourceBuffer>>& sources);
+
+// Parse, generate and emit a single source without any diagnostics dumps.
+// Everything it touches is local, so it is safe to call from several threads.
+bool compileFile(const std::string& input, const std::string& output, const DriverOptions& options);
+
+// Compile every input into its own object file on a work-stealing thread
+// pool, each worker with its own CodeGenContext. Returns the failure count.
+int compileBatch(const DriverOptions& options);
+
+#endif //TINYCOMPILER_DRIVER_H
@@ -0,0 +1,93 @@
+//
+// Streaming JSON output for the AST visualization, see visualization/disp.html.
+//
+
+#include <cassert>
+
+#include "JsonWriter.h"
+
+static const size_t flushThreshold = 64 * 1024;
+
+void appendJsonString(std::string &out, const std::string &str) {
+    for(char c: str){
+        switch( c ){
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if( (unsigned char)c < 0x20 ){
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else{
+                    out += c;
+                }
+        }
+    }
+}
+
+JsonWriter::~JsonWriter() {
+    close();
+}
+
+bool JsonWriter::open(const std::string &path) {
+    close();
+    _file = fopen(path.c_str(), "wb");
+    if( !_file ){
+        fprintf(stderr, "Can't open %s\n", path.c_str());
+        return false;
+    }
+    _failed = false;
+    _buffer.reserve(flushThreshold * 2);
+    return true;
+}
+
+bool JsonWriter::close() {
+    if( !_file )
+        return true;
+    assert(_hasChildren.empty() && "unterminated node");
+    bool success = !_failed && fwrite(_buffer.data(), 1, _buffer.size(), _file) == _buffer.size();
+    success = fclose(_file) == 0 && success;
+    _file = nullptr;
+    _buffer.clear();
+    return success;
+}
+
+void JsonWriter::flushIfFull() {
+    if( _buffer.size() >= flushThreshold ){
+        // once a write fails the file is incomplete, stop writing to it
+        if( !_failed && fwrite(_buffer.data(), 1, _buffer.size(), _file) != _buffer.size() )
+            _failed = true;
+        _buffer.clear();
+    }
+}
+
+void JsonWriter::writeRaw(const char *text) {
+    _buffer += text;
+}
+
+void JsonWriter::beginNode(const std::string &type, const std::string &detail) {
+    if( !_hasChildren.empty() ){
+        writeRaw(_hasChildren.back() ? "," : ",\"children\":[");
+        _hasChildren.back() = true;
+    }
+    writeRaw("{\"name\":\"");
+    appendJsonString(_buffer, type);
+    if( !detail.empty() ){
+        _buffer += ':';
+        appendJsonString(_buffer, detail);
+    }
+    _buffer += '"';
+    _hasChildren.push_back(false);
+}
+
+void JsonWriter::endNode() {
+    assert(!_hasChildren.empty());
+    writeRaw(_hasChildren.back() ? "]}" : "}");
+    _hasChildren.pop_back();
+    if( _hasChildren.empty() )
+        _buffer += '\n';
+    if( _file )
+        flushIfFull();
+}
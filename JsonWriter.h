@@ -0,0 +1,46 @@
+//
+// Streaming JSON output for the AST visualization, see visualization/disp.html.
+//
+
+#ifndef TINYCOMPILER_JSONWRITER_H
+#define TINYCOMPILER_JSONWRITER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Append str with JSON string escapes, without the surrounding quotes
+void appendJsonString(std::string& out, const std::string& str);
+
+// Writes {"name": ..., "children": [...]} objects straight to a file as the
+// tree is walked, so nothing but the current path is held in memory. Output
+// is collected in a buffer that is written out whenever it grows past 64KB.
+class JsonWriter{
+private:
+    FILE* _file = nullptr;
+    bool _failed = false;               // a write came up short, reported by close()
+    std::string _buffer;
+    std::vector<bool> _hasChildren;     // one entry per open node
+
+    void writeRaw(const char* text);
+    void flushIfFull();
+
+public:
+    JsonWriter(){}
+    ~JsonWriter();
+
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter& operator=(const JsonWriter&) = delete;
+
+    bool open(const std::string& path);
+
+    // Flushes and closes the file, returns false if any write failed
+    bool close();
+
+    // Start a node named "type" or "type:detail". Nodes begun before the
+    // matching endNode() become its children.
+    void beginNode(const std::string& type, const std::string& detail = "");
+    void endNode();
+};
+
+#endif //TINYCOMPILER_JSONWRITER_H
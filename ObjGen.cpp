@@ -9,26 +9,141 @@
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
 #include <llvm/ADT/Optional.h>
+#include <llvm/ADT/Triple.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/FormattedStream.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
 
 #include "CodeGen.h"
 #include "ObjGen.h"
+#include "TimeTrace.h"
 
 using namespace llvm;
 
+void resolveNativeTarget(std::string& cpu, std::string& features){
+    bool nativeFeatures = features == "native" || (cpu == "native" && features.empty());
+    if( cpu == "native" ){
+        cpu = sys::getHostCPUName().str();
+    }
+    if( !nativeFeatures ){
+        return;
+    }
+
+    features.clear();
+    StringMap<bool> hostFeatures;
+    if( !sys::getHostCPUFeatures(hostFeatures) ){
+        return;
+    }
+    // sorted so the string, and with it the compile cache key, is stable
+    std::vector<std::string> flags;
+    for(auto& feature: hostFeatures){
+        flags.push_back((feature.second ? "+" : "-") + feature.first().str());
+    }
+    std::sort(flags.begin(), flags.end());
+    for(auto& flag: flags){
+        if( !features.empty() )
+            features += ",";
+        features += flag;
+    }
+}
+
+CodeGenOpt::Level codeGenOptLevel(unsigned optLevel){
+    switch( optLevel ){
+        case 0: return CodeGenOpt::None;
+        case 1: return CodeGenOpt::Less;
+        case 2: return CodeGenOpt::Default;
+        default: return CodeGenOpt::Aggressive;
+    }
+}
+
+// The same function and module pipelines clang/opt build for -O1..-O3: SROA and
+// mem2reg, instcombine, GVN, LICM and the loop passes, inlining, and at -O2 and
+// above the loop and SLP vectorizers, all tuned by the target's TTI.
+void optimizeModule(Module& module, TargetMachine& targetMachine, unsigned optLevel){
+    TraceScope timeScope("Optimize", "O" + std::to_string(optLevel));
+
+    PassManagerBuilder builder;
+    builder.OptLevel = optLevel;
+    builder.SizeLevel = 0;
+    if( optLevel > 1 ){
+        builder.Inliner = createFunctionInliningPass(optLevel, 0);
+    } else{
+        builder.Inliner = createAlwaysInlinerPass();
+    }
+    builder.LoopVectorize = optLevel > 1;
+    builder.SLPVectorize = optLevel > 1;
+
+    legacy::FunctionPassManager functionPasses(&module);
+    functionPasses.add(createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+    builder.populateFunctionPassManager(functionPasses);
+
+    legacy::PassManager modulePasses;
+    modulePasses.add(new TargetLibraryInfoWrapperPass(Triple(module.getTargetTriple())));
+    modulePasses.add(createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+    builder.populateModulePassManager(modulePasses);
+
+    {
+        TraceScope functionScope("Function Passes");
+        functionPasses.doInitialization();
+        for(auto& function: module){
+            if( !function.isDeclaration() ){
+                functionPasses.run(function);
+            }
+        }
+        functionPasses.doFinalization();
+    }
+    {
+        TraceScope moduleScope("Module Passes");
+        modulePasses.run(module);
+    }
+}
+
+
+void initializeTargets(const std::string& triple){
+    // each set is registered once, even when several threads emit objects
+    static std::once_flag nativeInitialized;
+    std::call_once(nativeInitialized, []{
+        TraceScope timeScope("Initialize Native Target");
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+        InitializeNativeTargetAsmParser();
+    });
+
+    // $TINYCOMPILER_ALL_TARGETS restores the old register-everything start-up,
+    // the baseline bench/startup.sh compares against
+    static const bool allTargets = getenv("TINYCOMPILER_ALL_TARGETS") != nullptr;
+    bool hostOnly = triple.empty() || Triple(triple).getArch() == Triple(sys::getDefaultTargetTriple()).getArch();
+    if( hostOnly && !allTargets ){
+        return;
+    }
+
+    static std::once_flag allInitialized;
+    std::call_once(allInitialized, []{
+        TraceScope timeScope("Initialize All Targets");
+        InitializeAllTargetInfos();
+        InitializeAllTargets();
+        InitializeAllTargetMCs();
+        InitializeAllAsmParsers();
+        InitializeAllAsmPrinters();
+    });
+}
+
+bool ObjGen(CodeGenContext & context, raw_pwrite_stream& dest, const string& cpu, const string& features, unsigned optLevel, const string& triple){
 
-void ObjGen(CodeGenContext & context, const string& filename){
-    // Initialize the target registry etc.
-    InitializeAllTargetInfos();
-    InitializeAllTargets();
-    InitializeAllTargetMCs();
-    InitializeAllAsmParsers();
-    InitializeAllAsmPrinters();
+    initializeTargets(triple);
 
-    auto targetTriple = sys::getDefaultTargetTriple();
+    auto targetTriple = triple.empty() ? sys::getDefaultTargetTriple() : Triple::normalize(triple);
     context.theModule->setTargetTriple(targetTriple);
 
     std::string error;
@@ -36,21 +151,25 @@ void ObjGen(CodeGenContext & context, const string& filename){
 
     if( !Target ){
         errs() << error;
-        return;
+        return false;
     }
 
-    auto CPU = "generic";
-    auto features = "";
-
     TargetOptions opt;
     auto RM = Optional<Reloc::Model>();
-    auto theTargetMachine = Target->createTargetMachine(targetTriple, CPU, features, opt, RM);
+    std::unique_ptr<TargetMachine> theTargetMachine(Target->createTargetMachine(targetTriple, cpu, features, opt, RM, CodeModel::Default, codeGenOptLevel(optLevel)));
 
     context.theModule->setDataLayout(theTargetMachine->createDataLayout());
     context.theModule->setTargetTriple(targetTriple);
 
-    std::error_code EC;
-    raw_fd_ostream dest(filename.c_str(), EC, sys::fs::F_None);
+    if( optLevel > 0 ){
+        // the optimizers assume well formed IR, so refuse to run them on anything else
+        if( verifyModule(*context.theModule, &errs()) ){
+            errs() << "Generated IR is broken, can't optimize it\n";
+            return false;
+        }
+        optimizeModule(*context.theModule, *theTargetMachine, optLevel);
+    }
+
 //    raw_fd_ostream dest(filename.c_str(), EC, sys::fs::F_None);
 //    formatted_raw_ostream formattedRawOstream(dest);
 
@@ -59,14 +178,32 @@ void ObjGen(CodeGenContext & context, const string& filename){
 
     if( theTargetMachine->addPassesToEmitFile(pass, dest, fileType) ){
         errs() << "theTargetMachine can't emit a file of this type";
-        return;
+        return false;
     }
 
-    pass.run(*context.theModule.get());
+    {
+        TraceScope passScope("Backend Passes");
+        pass.run(*context.theModule.get());
+    }
     dest.flush();
+    return true;
+}
+
+bool ObjGen(CodeGenContext & context, const string& filename, const string& cpu, const string& features, unsigned optLevel, const string& triple){
+    TraceScope timeScope("Emit Object", filename);
+
+    std::error_code EC;
+    raw_fd_ostream dest(filename.c_str(), EC, sys::fs::F_None);
+    if( EC ){
+        errs() << "Could not open file " << filename << ": " << EC.message() << "\n";
+        return false;
+    }
+    if( !ObjGen(context, dest, cpu, features, optLevel, triple) ){
+        return false;
+    }
 
-    outs() << "Object code wrote to " << filename.c_str() << "\n";
+    cout << "Object code wrote to " << filename << endl;
 
-    return;
+    return true;
 }
 
@@ -5,6 +5,36 @@
 #ifndef TINYCOMPILER_OBJGEN_H
 #define TINYCOMPILER_OBJGEN_H
 
-void ObjGen(CodeGenContext & context, const string& filename = "output.o");
+#include <llvm/Support/CodeGen.h>
+
+#include <string>
+
+#include "CodeGen.h"
+
+namespace llvm{
+    class Module;
+    class raw_pwrite_stream;
+    class TargetMachine;
+}
+
+// Replace a cpu of "native" with the host CPU name, and a features string of
+// "native" (or an empty one alongside a native cpu) with every host feature
+void resolveNativeTarget(std::string& cpu, std::string& features);
+
+// Register the host backend, plus every other one the first time a triple for
+// a different architecture is requested (or always with $TINYCOMPILER_ALL_TARGETS
+// set). Empty triple means the host.
+void initializeTargets(const std::string& triple = "");
+
+// -O level -> backend optimisation level
+llvm::CodeGenOpt::Level codeGenOptLevel(unsigned optLevel);
+
+// Run the -O1..-O3 IR pipeline tuned for targetMachine over the module
+void optimizeModule(llvm::Module& module, llvm::TargetMachine& targetMachine, unsigned optLevel);
+
+// Emit into any seekable stream, e.g. a raw_svector_ostream for the daemon
+bool ObjGen(CodeGenContext & context, llvm::raw_pwrite_stream& dest, const string& cpu, const string& features, unsigned optLevel, const string& triple);
+
+bool ObjGen(CodeGenContext & context, const string& filename = "output.o", const string& cpu = "generic", const string& features = "", unsigned optLevel = 0, const string& triple = "");
 
 #endif //TINYCOMPILER_OBJGEN_H
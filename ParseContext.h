@@ -0,0 +1,70 @@
+//
+// Per-parse state for the reentrant flex scanner and bison parser.
+//
+
+#ifndef TINYCOMPILER_PARSECONTEXT_H
+#define TINYCOMPILER_PARSECONTEXT_H
+
+#include <cstdio>
+
+#include "ASTNodes.h"
+#include "Arena.h"
+#include "Symbol.h"
+#include "TimeTrace.h"
+
+class SourceBuffer;
+
+// Everything a parse touches lives here instead of in globals, so separate
+// contexts can parse on separate threads. Parsing several sources with the
+// same context appends their statements to one program, as if concatenated.
+// The AST is allocated in the context's arena and is released with it.
+class ParseContext{
+private:
+    void* scanner = nullptr;        // yyscan_t
+
+    bool runParser(const std::string& name);
+
+public:
+    Arena arena;
+    SymbolPool symbols;
+    NBlock* programBlock = nullptr;
+    int errors = 0;
+    TimeTrace::Clock::duration lexTime;     // time spent inside the scanner, only kept while tracing
+
+    ParseContext();
+    ~ParseContext();
+
+    ParseContext(const ParseContext&) = delete;
+    ParseContext& operator=(const ParseContext&) = delete;
+
+    // A SourceBuffer or text in memory may also hold a binary AST, see ASTSerializer.h
+    bool parse(SourceBuffer& source);
+    bool parse(FILE* file);
+    bool parse(const std::string& text, const std::string& name);
+
+    // Drop the program and its symbols but keep the scanner and the arena's
+    // first slab, so a long-lived context starts each parse warm
+    void reset(){
+        programBlock = nullptr;
+        errors = 0;
+        arena.reset();
+        symbols.clear();
+    }
+
+    // Hand over the program parsed so far and start a new one, as the REPL does per input
+    NBlock* takeProgram(){
+        NBlock* block = programBlock;
+        programBlock = nullptr;
+        return block;
+    }
+
+    void appendProgram(NBlock* block){
+        if( !programBlock ){
+            programBlock = block;
+        } else{
+            programBlock->statements->insert(programBlock->statements->end(), block->statements->begin(), block->statements->end());
+        }
+    }
+};
+
+#endif //TINYCOMPILER_PARSECONTEXT_H
@@ -0,0 +1,104 @@
+//
+// Wire format between the compile daemon and the tinyc client.
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Protocol.h"
+
+static bool writeAll(int fd, const char* data, size_t size){
+    while( size > 0 ){
+        ssize_t written = write(fd, data, size);
+        if( written < 0 ){
+            if( errno == EINTR )
+                continue;
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t size){
+    while( size > 0 ){
+        ssize_t got = read(fd, data, size);
+        if( got < 0 ){
+            if( errno == EINTR )
+                continue;
+            return false;
+        }
+        if( got == 0 )
+            return false;
+        data += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+bool writeFrame(int fd, const char *data, size_t size) {
+    if( size > maxFrameSize )
+        return false;
+    uint32_t length = (uint32_t)size;
+    return writeAll(fd, (const char*)&length, sizeof(length)) && writeAll(fd, data, size);
+}
+
+bool readFrame(int fd, std::string &data) {
+    uint32_t length;
+    if( !readAll(fd, (char*)&length, sizeof(length)) || length > maxFrameSize )
+        return false;
+    data.resize(length);
+    return length == 0 || readAll(fd, &data[0], length);
+}
+
+std::string defaultSocketPath() {
+    const char* env = getenv("TINYCOMPILER_SOCKET");
+    if( env && *env )
+        return env;
+    const char* runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if( runtimeDir && *runtimeDir )
+        return std::string(runtimeDir) + "/tinycompiler.sock";
+
+    // anyone can create names in /tmp, so whoever made the directory first
+    // must be us and nobody else may reach into it
+    std::string directory = "/tmp/tinycompiler-" + std::to_string(getuid());
+    if( mkdir(directory.c_str(), 0700) < 0 && errno != EEXIST ){
+        fprintf(stderr, "Can't create %s: %s\n", directory.c_str(), strerror(errno));
+        return "";
+    }
+    struct stat info;
+    if( lstat(directory.c_str(), &info) < 0 ){
+        fprintf(stderr, "Can't stat %s: %s\n", directory.c_str(), strerror(errno));
+        return "";
+    }
+    if( !S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & 077) != 0 ){
+        fprintf(stderr, "%s is not a directory private to this user, refusing to use it\n", directory.c_str());
+        return "";
+    }
+    return directory + "/daemon.sock";
+}
+
+const char* optionValueName(const std::string &arg) {
+    static const struct{
+        const char* option;
+        const char* value;
+    } options[] = {
+        {"-o", "a file name"},
+        {"-j", "a thread count"},
+        {"--socket", "a path"},
+        {"--cache-dir", "a directory"},
+        {"--mcpu", "a value"},
+        {"--mattr", "a value"},
+        {"--mtriple", "a value"},
+    };
+    for(auto& option: options){
+        if( arg == option.option )
+            return option.value;
+    }
+    return nullptr;
+}
@@ -0,0 +1,41 @@
+//
+// Wire format between the compile daemon and the tinyc client.
+//
+
+#ifndef TINYCOMPILER_PROTOCOL_H
+#define TINYCOMPILER_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Everything is sent as frames: a uint32 length in host byte order (both ends
+// share a machine) followed by that many bytes. One connection carries one
+// request and its response.
+//
+// request:  "TINY1", options (NUL separated argv), source count,
+//           then a name frame and a text frame per source
+// response: status ("0" ok, anything else failed), message, object bytes
+#define TINYCOMPILER_PROTOCOL_MAGIC "TINY1"
+
+const uint32_t maxFrameSize = 256u << 20;
+
+bool writeFrame(int fd, const char* data, size_t size);
+
+inline bool writeFrame(int fd, const std::string& data){
+    return writeFrame(fd, data.data(), data.size());
+}
+
+bool readFrame(int fd, std::string& data);
+
+// $TINYCOMPILER_SOCKET, else tinycompiler.sock in $XDG_RUNTIME_DIR, else in a
+// /tmp/tinycompiler-<uid> directory created with mode 0700. Empty, after a
+// message on stderr, when that directory is not private to the current user.
+std::string defaultSocketPath();
+
+// What the option expects as its next argument ("a path"), nullptr when it
+// takes none. Shared by parseDriverOptions and tinyc, which has to skip the
+// values of the options it forwards.
+const char* optionValueName(const std::string& arg);
+
+#endif //TINYCOMPILER_PROTOCOL_H
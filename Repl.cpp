@@ -0,0 +1,215 @@
+//
+// Interactive read-eval-print loop on top of the ORC JIT.
+//
+
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdio>
+
+#include "ASTSimplifier.h"
+#include "ObjGen.h"
+#include "Repl.h"
+#include "SourceBuffer.h"
+
+// change in brace depth over one line, ignoring string literals and # comments
+static int braceDelta(const std::string& line){
+    int delta = 0;
+    bool inString = false;
+    for(size_t i=0; i<line.size(); i++){
+        char c = line[i];
+        if( inString ){
+            if( c == '\\' )
+                i++;
+            else if( c == '"' )
+                inString = false;
+        } else if( c == '"' ){
+            inString = true;
+        } else if( c == '#' ){
+            break;
+        } else if( c == '{' ){
+            delta++;
+        } else if( c == '}' ){
+            delta--;
+        }
+    }
+    return delta;
+}
+
+static void collectDefinitions(NBlock& input, std::set<std::string>& names){
+    for(auto statement: *input.statements){
+        if( auto function = dynamic_cast<NFunctionDeclaration*>(statement) ){
+            names.insert(function->id->name.str());
+        } else if( auto variable = dynamic_cast<NVariableDeclaration*>(statement) ){
+            names.insert(variable->id->name.str());
+        } else if( auto array = dynamic_cast<NArrayInitialization*>(statement) ){
+            names.insert(array->declaration->id->name.str());
+        }
+    }
+}
+
+Repl::Repl(const DriverOptions &options)
+        : _options(options), _jit(TinyJIT::create(options.cpu, options.features, options.optLevel)) {
+    _context.printIR = false;
+    _context.topLevelGlobals = true;
+    _context.targetCPU = options.cpu;
+    _context.targetFeatures = options.features;
+    // scope of the top-level variables, kept for the whole session
+    _context.pushBlock(nullptr);
+}
+
+void Repl::declarePrevious(const std::set<std::string> &redefined) {
+    Module& module = *_context.theModule;
+    for(auto& function: _functions){
+        if( !redefined.count(function.first) ){
+            Function::Create(function.second, GlobalValue::ExternalLinkage, function.first, &module);
+        }
+    }
+    for(auto& global: _globals){
+        if( !redefined.count(global.first) ){
+            auto declaration = new GlobalVariable(module, global.second, false, GlobalValue::ExternalLinkage, nullptr, global.first);
+            _context.setSymbolValue(_parseContext.symbols.symbol(global.first), declaration);
+        }
+    }
+}
+
+void Repl::printResult(Value* value) {
+    Type* type = value->getType();
+    const char* format = nullptr;
+    if( type->isIntegerTy(64) ){
+        format = "=> %lld\n";
+    } else if( type->isIntegerTy() ){
+        // comparisons and && || ! give an i1, which prints as 0 or 1
+        value = _context.builder.CreateIntCast(value, Type::getInt32Ty(_context.llvmContext), !type->isIntegerTy(1));
+        format = "=> %d\n";
+    } else if( type->isDoubleTy() ){
+        format = "=> %f\n";
+    } else{
+        return;
+    }
+
+    std::vector<Type*> printfArgs{ Type::getInt8PtrTy(_context.llvmContext) };
+    auto printfType = FunctionType::get(Type::getInt32Ty(_context.llvmContext), printfArgs, true);
+    auto printfFunction = _context.theModule->getOrInsertFunction("printf", printfType);
+    std::vector<Value*> args{ _context.builder.CreateGlobalStringPtr(format), value };
+    _context.builder.CreateCall(printfFunction, args);
+}
+
+bool Repl::evaluate(NBlock &input) {
+    std::string suffix = std::to_string(++_inputCount);
+    if( _options.fold )
+        ASTSimplifier(_parseContext.arena).run(input);
+    _context.theModule.reset(new Module("repl" + suffix, _context.llvmContext));
+    Module& module = *_context.theModule;
+
+    // names this input defines again shadow the earlier definitions
+    std::set<std::string> defined;
+    collectDefinitions(input, defined);
+    declarePrevious(defined);
+
+    auto paramKinds = _context.savedParamKinds();
+    std::vector<NStatement*> statements;
+    for(auto statement: *input.statements){
+        if( dynamic_cast<NFunctionDeclaration*>(statement) || dynamic_cast<NStructDeclaration*>(statement) ){
+            statement->codeGen(_context);
+        } else{
+            statements.push_back(statement);
+        }
+    }
+
+    std::string entryName = "__repl_" + suffix;
+    FunctionType* entryType = FunctionType::get(Type::getVoidTy(_context.llvmContext), false);
+    Function* entry = Function::Create(entryType, GlobalValue::ExternalLinkage, entryName, &module);
+    _context.builder.SetInsertPoint(BasicBlock::Create(_context.llvmContext, "entry", entry));
+    for(size_t i=0; i<statements.size(); i++){
+        Value* value = statements[i]->codeGen(_context);
+        // echo the value of a trailing expression, like `1 + 2` or `f(3)`
+        if( value && i + 1 == statements.size() && dynamic_cast<NExpressionStatement*>(statements[i]) ){
+            printResult(value);
+        }
+    }
+    _context.builder.CreateRetVoid();
+
+    if( verifyModule(module, &errs()) ){
+        errs() << "Input " << suffix << " generated broken IR, discarded\n";
+        // forget what it declared, the values belong to the dropped module
+        for(auto& name: defined){
+            _context.setSymbolValue(_parseContext.symbols.symbol(name), nullptr);
+        }
+        _context.restoreParamKinds(std::move(paramKinds));
+        _context.theModule.reset();
+        return false;
+    }
+
+    for(auto& function: module){
+        if( function.getName() != entryName ){
+            _functions[function.getName().str()] = function.getFunctionType();
+        }
+    }
+    for(auto& global: module.globals()){
+        if( defined.count(global.getName().str()) ){
+            _globals[global.getName().str()] = global.getValueType();
+        }
+    }
+
+    if( _options.optLevel > 0 ){
+        module.setDataLayout(_jit->getTargetMachine().createDataLayout());
+        module.setTargetTriple(_jit->getTargetMachine().getTargetTriple().str());
+        optimizeModule(module, _jit->getTargetMachine(), _options.optLevel);
+    }
+    _jit->addModule(std::move(_context.theModule));
+
+    auto symbol = _jit->findSymbol(entryName);
+    if( !symbol ){
+        LogErrorV("Input " + suffix + " was not emitted by the JIT");
+        return false;
+    }
+    std::cout.flush();
+    ((void (*)())(intptr_t)symbol.getAddress())();
+    fflush(stdout);
+    return true;
+}
+
+int Repl::run(std::istream &in) {
+    if( !_jit )
+        return 1;
+
+    for(auto& input: _options.inputs){
+        auto source = SourceBuffer::open(input);
+        if( !source || !_parseContext.parse(*source) ){
+            fprintf(stderr, "Failed to load %s\n", input.c_str());
+            continue;
+        }
+        evaluate(*_parseContext.takeProgram());
+    }
+
+    std::string text;
+    int depth = 0;
+    std::string line;
+    while( true ){
+        std::cout << (text.empty() ? "tiny> " : "....> ") << std::flush;
+        if( !std::getline(in, line) )
+            break;
+        if( text.empty() && (line == ":quit" || line == ":q") )
+            break;
+
+        text += line;
+        text += "\n";
+        depth += braceDelta(line);
+        if( depth > 0 )
+            continue;
+
+        if( text.find_first_not_of(" \t\r\n") != std::string::npos ){
+            std::string name = "<input " + std::to_string(_inputCount + 1) + ">";
+            if( _parseContext.parse(text, name) && _parseContext.programBlock ){
+                evaluate(*_parseContext.takeProgram());
+            } else{
+                _parseContext.takeProgram();
+            }
+        }
+        text.clear();
+        depth = 0;
+    }
+    std::cout << std::endl;
+    return 0;
+}
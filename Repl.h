@@ -0,0 +1,51 @@
+//
+// Interactive read-eval-print loop on top of the ORC JIT.
+//
+
+#ifndef TINYCOMPILER_REPL_H
+#define TINYCOMPILER_REPL_H
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+#include "CodeGen.h"
+#include "Driver.h"
+#include "ParseContext.h"
+#include "TinyJIT.h"
+
+// Every input becomes a fresh module in one long-lived LLVMContext: struct and
+// function declarations are generated as usual, and the remaining statements
+// are wrapped in a __repl_N function that is run as soon as the module has
+// been added to the JIT. The CodeGenContext, its TypeSystem and the parse
+// arena outlive the inputs, so struct types, variable types and array sizes
+// carry over; functions and top-level variables (module globals here) are
+// re-declared as externals in each new module and resolved by the JIT.
+class Repl{
+private:
+    const DriverOptions& _options;
+    ParseContext _parseContext;
+    CodeGenContext _context;
+    std::unique_ptr<TinyJIT> _jit;     // nullptr when the host target can't be set up
+    unsigned _inputCount = 0;
+
+    std::map<std::string, FunctionType*> _functions;
+    std::map<std::string, Type*> _globals;
+
+    void declarePrevious(const std::set<std::string>& redefined);
+    void printResult(Value* value);
+
+public:
+    explicit Repl(const DriverOptions& options);
+
+    // Generate, JIT and run one parsed input. Returns false if nothing ran.
+    bool evaluate(NBlock& input);
+
+    // Prompt for inputs until EOF or :quit. An input ends at the first line
+    // where every brace opened so far is closed again.
+    int run(std::istream& in);
+};
+
+#endif //TINYCOMPILER_REPL_H
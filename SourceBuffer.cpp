@@ -0,0 +1,67 @@
+//
+// Memory-mapped source files handed to the flex scanner without copying.
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SourceBuffer.h"
+
+std::unique_ptr<SourceBuffer> SourceBuffer::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if( fd < 0 ){
+        fprintf(stderr, "Can't open %s: %s\n", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    struct stat st;
+    if( fstat(fd, &st) != 0 ){
+        fprintf(stderr, "Can't stat %s: %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = (size_t)st.st_size;
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mappedSize = (size + 2 + pageSize - 1) / pageSize * pageSize;
+
+    // Reserve zeroed anonymous memory covering the file plus its terminators,
+    // then map the file over the front of it. The tail of the last file page
+    // is zero-filled by the kernel and any further page stays anonymous, so the
+    // two bytes after the text always read as NUL without copying anything.
+    void* base = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if( base == MAP_FAILED ){
+        fprintf(stderr, "Can't map %s: %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    if( size > 0 && mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED ){
+        fprintf(stderr, "Can't map %s: %s\n", path.c_str(), strerror(errno));
+        munmap(base, mappedSize);
+        close(fd);
+        return nullptr;
+    }
+    close(fd);
+
+    madvise(base, mappedSize, MADV_SEQUENTIAL);
+
+    std::unique_ptr<SourceBuffer> buffer(new SourceBuffer());
+    buffer->_data = (char*)base;
+    buffer->_size = size;
+    buffer->_mappedSize = mappedSize;
+    buffer->_path = path;
+    return buffer;
+}
+
+SourceBuffer::~SourceBuffer() {
+    if( _data ){
+        munmap(_data, _mappedSize);
+    }
+}
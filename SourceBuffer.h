@@ -0,0 +1,52 @@
+//
+// Memory-mapped source files handed to the flex scanner without copying.
+//
+
+#ifndef TINYCOMPILER_SOURCEBUFFER_H
+#define TINYCOMPILER_SOURCEBUFFER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// The file contents are mapped privately and followed by the two NUL bytes
+// flex expects at the end of a buffer passed to yy_scan_buffer. The mapping is
+// writable (copy-on-write) because the scanner pokes terminators into it.
+class SourceBuffer{
+private:
+    char* _data = nullptr;
+    size_t _size = 0;
+    size_t _mappedSize = 0;
+    std::string _path;
+
+    SourceBuffer(){}
+
+public:
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    // Returns nullptr and reports to stderr when the file can't be mapped
+    static std::unique_ptr<SourceBuffer> open(const std::string& path);
+
+    char* data() const{
+        return _data;
+    }
+
+    // Length of the source text, excluding the trailing NULs
+    size_t size() const{
+        return _size;
+    }
+
+    // Length to hand to yy_scan_buffer, including the trailing NULs
+    size_t scanSize() const{
+        return _size + 2;
+    }
+
+    const std::string& path() const{
+        return _path;
+    }
+};
+
+#endif //TINYCOMPILER_SOURCEBUFFER_H
@@ -0,0 +1,18 @@
+//
+// Interned identifiers and literals shared by the lexer, the AST and codegen.
+//
+
+#include "Symbol.h"
+
+SymbolPool::SymbolPool() {
+    _entries.push_back(SymbolEntry{std::string(), 0});
+    _index[""] = 0;
+}
+
+SymbolID SymbolPool::intern(const char *text, size_t length) {
+    auto result = _index.insert(std::make_pair(llvm::StringRef(text, length), (SymbolID)_entries.size()));
+    if( result.second ){
+        _entries.push_back(SymbolEntry{std::string(text, length), result.first->second});
+    }
+    return result.first->second;
+}
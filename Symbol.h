@@ -0,0 +1,107 @@
+//
+// Interned identifiers and literals shared by the lexer, the AST and codegen.
+//
+
+#ifndef TINYCOMPILER_SYMBOL_H
+#define TINYCOMPILER_SYMBOL_H
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+
+using SymbolID = uint32_t;
+
+struct SymbolEntry{
+    std::string text;
+    SymbolID id;
+};
+
+// A cheap, copyable handle to an interned string. Two symbols from the same
+// pool are equal iff their texts are equal, so comparisons are pointer compares.
+class Symbol{
+private:
+    const SymbolEntry* _entry = nullptr;
+
+public:
+    Symbol(){}
+
+    explicit Symbol(const SymbolEntry* entry): _entry(entry){}
+
+    const std::string& str() const{
+        static const std::string empty;
+        return _entry ? _entry->text : empty;
+    }
+
+    const char* c_str() const{
+        return str().c_str();
+    }
+
+    SymbolID id() const{
+        return _entry ? _entry->id : 0;
+    }
+
+    bool empty() const{
+        return str().empty();
+    }
+
+    operator const std::string&() const{
+        return str();
+    }
+
+    bool operator==(const Symbol& other) const{
+        return _entry == other._entry;
+    }
+
+    bool operator!=(const Symbol& other) const{
+        return _entry != other._entry;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Symbol& symbol){
+    return os << symbol.str();
+}
+
+// Owns the text of every symbol handed out. IDs are dense and start from 1,
+// 0 is reserved for the empty symbol.
+class SymbolPool{
+private:
+    std::deque<SymbolEntry> _entries;
+    llvm::StringMap<SymbolID> _index;
+
+public:
+    SymbolPool();
+
+    SymbolPool(const SymbolPool&) = delete;
+    SymbolPool& operator=(const SymbolPool&) = delete;
+
+    SymbolID intern(const char* text, size_t length);
+
+    SymbolID intern(llvm::StringRef text){
+        return intern(text.data(), text.size());
+    }
+
+    Symbol get(SymbolID id) const{
+        return Symbol(&_entries[id]);
+    }
+
+    Symbol symbol(llvm::StringRef text){
+        return get(intern(text));
+    }
+
+    size_t size() const{
+        return _entries.size();
+    }
+
+    // Forget everything but the empty symbol; outstanding Symbols dangle
+    void clear(){
+        _index.clear();
+        _entries.resize(1);
+        _index[""] = 0;
+    }
+};
+
+#endif //TINYCOMPILER_SYMBOL_H
@@ -0,0 +1,98 @@
+//
+// Work-stealing thread pool used to compile many sources at once.
+//
+
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+// index of the pool worker running on this thread, or -1 outside the pool
+static thread_local long currentWorker = -1;
+
+ThreadPool::ThreadPool(unsigned threadCount): _queued(0), _pending(0), _nextQueue(0) {
+    if( threadCount == 0 ){
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for(unsigned i=0; i<threadCount; i++){
+        _queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    for(unsigned i=0; i<threadCount; i++){
+        _threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for(auto& thread: _threads){
+        thread.join();
+    }
+}
+
+void ThreadPool::async(std::function<void()> task) {
+    // tasks spawned by a worker stay local to it, others are spread round robin
+    size_t target = currentWorker >= 0 ? (size_t)currentWorker : _nextQueue++ % _queues.size();
+    _pending++;
+    {
+        std::lock_guard<std::mutex> lock(_queues[target]->mutex);
+        _queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queued++;
+    }
+    _wake.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this]{ return _pending == 0; });
+}
+
+bool ThreadPool::popTask(size_t self, std::function<void()> &task) {
+    {
+        WorkQueue& own = *_queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if( !own.tasks.empty() ){
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for(size_t i=1; i<_queues.size(); i++){
+        WorkQueue& victim = *_queues[(self + i) % _queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if( !victim.tasks.empty() ){
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    currentWorker = (long)self;
+    while( true ){
+        std::function<void()> task;
+        if( popTask(self, task) ){
+            _queued--;
+            task();
+            if( --_pending == 0 ){
+                std::lock_guard<std::mutex> lock(_mutex);
+                _idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait(lock, [this]{ return _stop || _queued > 0; });
+        if( _stop && _queued == 0 ){
+            return;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+//
+// Work-stealing thread pool used to compile many sources at once.
+//
+
+#ifndef TINYCOMPILER_THREADPOOL_H
+#define TINYCOMPILER_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Every worker owns a deque of tasks. A worker takes work from the back of its
+// own deque and, when that runs dry, steals from the front of the others', so
+// a few long compilations don't leave the rest of the pool idle.
+class ThreadPool{
+private:
+    struct WorkQueue{
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> _queues;
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    std::atomic<size_t> _queued;
+    std::atomic<size_t> _pending;
+    std::atomic<size_t> _nextQueue;
+    bool _stop = false;
+
+    bool popTask(size_t self, std::function<void()>& task);
+    void workerLoop(size_t self);
+
+public:
+    // 0 means one thread per hardware thread
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void async(std::function<void()> task);
+
+    // Block until every task submitted so far has finished
+    void wait();
+
+    size_t size() const{
+        return _threads.size();
+    }
+};
+
+#endif //TINYCOMPILER_THREADPOOL_H
@@ -0,0 +1,71 @@
+//
+// Scoped compile-time timers written out in Chrome trace_event format.
+//
+
+#include <cstdio>
+#include <fstream>
+
+#include "JsonWriter.h"
+#include "TimeTrace.h"
+
+std::atomic<bool> TimeTrace::_enabled(false);
+std::mutex TimeTrace::_mutex;
+std::vector<TimeTrace::Event> TimeTrace::_events;
+TimeTrace::Clock::time_point TimeTrace::_begin;
+
+static std::atomic<unsigned> nextThreadId(0);
+static thread_local unsigned threadId = nextThreadId++;
+
+static void writeString(std::ostream& out, const std::string& str){
+    std::string escaped;
+    appendJsonString(escaped, str);
+    out << '"' << escaped << '"';
+}
+
+static double microseconds(TimeTrace::Clock::duration duration){
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+void TimeTrace::enable() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _begin = Clock::now();
+    _events.clear();
+    _enabled = true;
+}
+
+void TimeTrace::record(const std::string &name, const std::string &detail, Clock::time_point start, Clock::duration duration) {
+    Event event{name, detail, start, duration, threadId};
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.push_back(std::move(event));
+}
+
+bool TimeTrace::write(const std::string &path) {
+    std::ofstream out(path);
+    if( !out.is_open() ){
+        fprintf(stderr, "Can't open time trace file %s\n", path.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for(auto& event: _events){
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"name\":";
+        writeString(out, event.name);
+        out << ",\"cat\":\"tinycompiler\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.tid
+            << ",\"ts\":" << microseconds(event.start - _begin)
+            << ",\"dur\":" << microseconds(event.duration);
+        if( !event.detail.empty() ){
+            out << ",\"args\":{\"detail\":";
+            writeString(out, event.detail);
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out.good();
+}
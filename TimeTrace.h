@@ -0,0 +1,75 @@
+//
+// Scoped compile-time timers written out in Chrome trace_event format.
+//
+
+#ifndef TINYCOMPILER_TIMETRACE_H
+#define TINYCOMPILER_TIMETRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process wide list of complete ("ph":"X") events. Recording is off until
+// enable() is called, so the scopes below cost one atomic load otherwise.
+// Events from different threads are told apart by a small per-thread id,
+// which keeps batch compiles readable in the trace viewer.
+class TimeTrace{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+private:
+    struct Event{
+        std::string name;
+        std::string detail;
+        Clock::time_point start;
+        Clock::duration duration;
+        unsigned tid;
+    };
+
+    static std::atomic<bool> _enabled;
+    static std::mutex _mutex;
+    static std::vector<Event> _events;
+    static Clock::time_point _begin;
+
+public:
+    static void enable();
+    static bool enabled(){
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    static void record(const std::string& name, const std::string& detail, Clock::time_point start, Clock::duration duration);
+
+    // Write {"traceEvents":[...]} to path, loadable by chrome://tracing or Perfetto
+    static bool write(const std::string& path);
+};
+
+// Records [construction, destruction) as one event when tracing is enabled
+class TraceScope{
+private:
+    std::string _name;
+    std::string _detail;
+    TimeTrace::Clock::time_point _start;
+    bool _active;
+
+public:
+    explicit TraceScope(const std::string& name, const std::string& detail = ""): _active(TimeTrace::enabled()) {
+        if( _active ){
+            _name = name;
+            _detail = detail;
+            _start = TimeTrace::Clock::now();
+        }
+    }
+
+    ~TraceScope(){
+        if( _active ){
+            TimeTrace::record(_name, _detail, _start, TimeTrace::Clock::now() - _start);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#endif //TINYCOMPILER_TIMETRACE_H
@@ -0,0 +1,173 @@
+//
+// In-process execution of generated modules on the ORC JIT.
+//
+
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+
+#include "CodeGen.h"
+#include "ObjGen.h"
+#include "TimeTrace.h"
+#include "TinyJIT.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+static TargetMachine* createHostTargetMachine(const std::string& cpu, const std::string& features, unsigned optLevel){
+    initializeTargets();
+
+    // make the compiler's own symbols (and libc) visible to JIT'd code
+    static std::once_flag processLoaded;
+    std::call_once(processLoaded, []{
+        sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    });
+
+    auto triple = sys::getProcessTriple();
+    std::string error;
+    auto target = TargetRegistry::lookupTarget(triple, error);
+    if( !target ){
+        errs() << error << "\n";
+        return nullptr;
+    }
+    TargetOptions options;
+    auto machine = target->createTargetMachine(triple, cpu, features, options, Optional<Reloc::Model>(), CodeModel::JITDefault, codeGenOptLevel(optLevel));
+    if( !machine ){
+        errs() << "Can't create a target machine for " << triple << "\n";
+    }
+    return machine;
+}
+
+template <typename T> static std::vector<T> singletonSet(T t){
+    std::vector<T> set;
+    set.push_back(std::move(t));
+    return set;
+}
+
+TinyJIT::TinyJIT(std::unique_ptr<TargetMachine> targetMachine)
+        : _targetMachine(std::move(targetMachine)),
+          _dataLayout(_targetMachine->createDataLayout()),
+          _compileLayer(_objectLayer, SimpleCompiler(*_targetMachine)) {
+}
+
+std::unique_ptr<TinyJIT> TinyJIT::create(const std::string &cpu, const std::string &features, unsigned optLevel) {
+    std::unique_ptr<TargetMachine> targetMachine(createHostTargetMachine(cpu, features, optLevel));
+    if( !targetMachine )
+        return nullptr;
+    return std::unique_ptr<TinyJIT>(new TinyJIT(std::move(targetMachine)));
+}
+
+std::string TinyJIT::mangle(const std::string &name) const {
+    std::string mangledName;
+    {
+        raw_string_ostream mangledNameStream(mangledName);
+        Mangler::getNameWithPrefix(mangledNameStream, name, _dataLayout);
+    }
+    return mangledName;
+}
+
+JITSymbol TinyJIT::findMangledSymbol(const std::string &name) {
+    for(auto it=_moduleHandles.rbegin(); it!=_moduleHandles.rend(); it++){
+        if( auto symbol = _compileLayer.findSymbolIn(*it, name, true) )
+            return symbol;
+    }
+    if( auto address = RTDyldMemoryManager::getSymbolAddressInProcess(name) )
+        return JITSymbol(address, JITSymbolFlags::Exported);
+    return nullptr;
+}
+
+TinyJIT::ModuleHandle TinyJIT::addModule(std::unique_ptr<Module> module) {
+    module->setDataLayout(_dataLayout);
+    module->setTargetTriple(_targetMachine->getTargetTriple().str());
+
+    auto resolver = createLambdaResolver(
+            [this](const std::string& name){
+                if( auto symbol = findMangledSymbol(name) )
+                    return RuntimeDyld::SymbolInfo(symbol.getAddress(), symbol.getFlags());
+                return RuntimeDyld::SymbolInfo(nullptr);
+            },
+            [](const std::string& name){
+                return nullptr;
+            });
+
+    auto handle = _compileLayer.addModuleSet(singletonSet(std::move(module)),
+                                             std::unique_ptr<SectionMemoryManager>(new SectionMemoryManager()),
+                                             std::move(resolver));
+    _moduleHandles.push_back(handle);
+    return handle;
+}
+
+void TinyJIT::removeModule(ModuleHandle handle) {
+    for(auto it=_moduleHandles.begin(); it!=_moduleHandles.end(); it++){
+        if( *it == handle ){
+            _moduleHandles.erase(it);
+            break;
+        }
+    }
+    _compileLayer.removeModuleSet(handle);
+}
+
+JITSymbol TinyJIT::findSymbol(const std::string &name) {
+    return findMangledSymbol(mangle(name));
+}
+
+int runModule(std::unique_ptr<Module> module, const std::string &cpu, const std::string &features, unsigned optLevel) {
+    TraceScope timeScope("JIT");
+
+    Function* mainFunction = module->getFunction("main");
+    if( !mainFunction || mainFunction->isDeclaration() ){
+        LogErrorV("No main function to run");
+        return -1;
+    }
+    Type* returnType = mainFunction->getReturnType();
+
+    auto jit = TinyJIT::create(cpu, features, optLevel);
+    if( !jit )
+        return -1;
+    if( optLevel > 0 ){
+        module->setDataLayout(jit->getTargetMachine().createDataLayout());
+        module->setTargetTriple(jit->getTargetMachine().getTargetTriple().str());
+        if( verifyModule(*module, &errs()) ){
+            errs() << "Generated IR is broken, can't optimize it\n";
+            return -1;
+        }
+        optimizeModule(*module, jit->getTargetMachine(), optLevel);
+    }
+
+    {
+        TraceScope compileScope("JIT Compile");
+        jit->addModule(std::move(module));
+    }
+    auto symbol = jit->findSymbol("main");
+    if( !symbol ){
+        LogErrorV("main was not emitted by the JIT");
+        return -1;
+    }
+
+    // the program shares stdout with the compiler's diagnostics
+    std::cout.flush();
+    fflush(stdout);
+
+    TraceScope runScope("Run main");
+    auto address = symbol.getAddress();
+    if( returnType->isIntegerTy(64) ){
+        return (int)((int64_t (*)())(intptr_t)address)();
+    }
+    if( returnType->isIntegerTy() ){
+        return ((int (*)())(intptr_t)address)();
+    }
+    ((void (*)())(intptr_t)address)();
+    return 0;
+}
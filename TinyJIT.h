@@ -0,0 +1,67 @@
+//
+// In-process execution of generated modules on the ORC JIT.
+//
+
+#ifndef TINYCOMPILER_TINYJIT_H
+#define TINYCOMPILER_TINYJIT_H
+
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/JITSymbol.h>
+#include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Eagerly compiles whole modules for the host, in the style of the LLVM
+// KaleidoscopeJIT. Symbols are looked up newest module first and then in
+// the compiler process itself, so `extern` declarations such as printf or
+// scanf bind to the host C library without any linking step.
+class TinyJIT{
+private:
+    typedef llvm::orc::ObjectLinkingLayer<> ObjectLayer;
+    typedef llvm::orc::IRCompileLayer<ObjectLayer> CompileLayer;
+
+public:
+    typedef CompileLayer::ModuleSetHandleT ModuleHandle;
+
+private:
+    std::unique_ptr<llvm::TargetMachine> _targetMachine;
+    const llvm::DataLayout _dataLayout;
+    ObjectLayer _objectLayer;
+    CompileLayer _compileLayer;
+    std::vector<ModuleHandle> _moduleHandles;
+
+    explicit TinyJIT(std::unique_ptr<llvm::TargetMachine> targetMachine);
+
+    std::string mangle(const std::string& name) const;
+    llvm::orc::JITSymbol findMangledSymbol(const std::string& name);
+
+public:
+    // A JIT for the host CPU, or nullptr after a message on stderr when no
+    // target machine can be made for it (e.g. an unknown --mcpu)
+    static std::unique_ptr<TinyJIT> create(const std::string& cpu, const std::string& features, unsigned optLevel);
+
+    TinyJIT(const TinyJIT&) = delete;
+    TinyJIT& operator=(const TinyJIT&) = delete;
+
+    llvm::TargetMachine& getTargetMachine(){
+        return *_targetMachine;
+    }
+
+    // Set the module's layout to the JIT's, compile it and make its symbols visible
+    ModuleHandle addModule(std::unique_ptr<llvm::Module> module);
+    void removeModule(ModuleHandle handle);
+
+    llvm::orc::JITSymbol findSymbol(const std::string& name);
+};
+
+// Optimise and JIT the module, then call its `main` and return the result
+// as the exit code. Returns -1 with a message if there is no main to call.
+int runModule(std::unique_ptr<llvm::Module> module, const std::string& cpu, const std::string& features, unsigned optLevel);
+
+#endif //TINYCOMPILER_TINYJIT_H
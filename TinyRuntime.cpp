@@ -0,0 +1,110 @@
+//
+// Runtime support for compiled programs: the heap behind new and delete.
+//
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "TinyRuntime.h"
+
+// Kept free of the C++ runtime and of LLVM so that libtinyrt.a links into a
+// plain C program; the per-thread state is a POD with no destructor.
+namespace{
+
+const size_t alignment = 16;
+const size_t chunkSize = 1 << 20;
+
+struct Chunk{
+    Chunk* next;
+    size_t size;            // usable bytes after the header
+};
+
+const size_t headerSize = (sizeof(Chunk) + alignment - 1) & ~(alignment - 1);
+
+struct RuntimeArena{
+    Chunk* chunks;          // the chunk being bumped first, if it is a regular one
+    char* next;
+    char* end;
+    char* last;             // start of the latest allocation, for tinyrt_free
+};
+
+thread_local RuntimeArena arena;
+
+char* data(Chunk* chunk){
+    return reinterpret_cast<char*>(chunk) + headerSize;
+}
+
+Chunk* newChunk(size_t size){
+    Chunk* chunk = static_cast<Chunk*>(malloc(headerSize + size));
+    if( !chunk ){
+        fprintf(stderr, "tinyrt: out of memory allocating %zu bytes\n", size);
+        abort();
+    }
+    chunk->next = nullptr;
+    chunk->size = size;
+    return chunk;
+}
+
+}
+
+void* tinyrt_alloc(uint64_t size) {
+    if( size > SIZE_MAX - headerSize - alignment ){
+        fprintf(stderr, "tinyrt: allocation of %llu bytes is too large\n", (unsigned long long)size);
+        abort();
+    }
+    size_t rounded = size == 0 ? alignment : (size + alignment - 1) & ~(alignment - 1);
+
+    if( rounded > (size_t)(arena.end - arena.next) ){
+        if( rounded > chunkSize / 4 ){
+            // a big block lives in its own chunk, linked behind the one being bumped
+            Chunk* chunk = newChunk(rounded);
+            if( arena.chunks ){
+                chunk->next = arena.chunks->next;
+                arena.chunks->next = chunk;
+            }else{
+                arena.chunks = chunk;
+            }
+            arena.last = nullptr;
+            return data(chunk);
+        }
+
+        Chunk* chunk = newChunk(chunkSize);
+        chunk->next = arena.chunks;
+        arena.chunks = chunk;
+        arena.next = data(chunk);
+        arena.end = arena.next + chunkSize;
+    }
+
+    arena.last = arena.next;
+    arena.next += rounded;
+    return arena.last;
+}
+
+void tinyrt_free(void *pointer) {
+    if( pointer && pointer == arena.last ){
+        arena.next = arena.last;
+        arena.last = nullptr;
+    }
+}
+
+void tinyrt_release() {
+    Chunk* keep = nullptr;
+    for(Chunk* chunk=arena.chunks; chunk; ){
+        Chunk* next = chunk->next;
+        if( !keep && chunk->size == chunkSize )
+            keep = chunk;
+        else
+            free(chunk);
+        chunk = next;
+    }
+
+    arena.chunks = keep;
+    arena.last = nullptr;
+    if( keep ){
+        keep->next = nullptr;
+        arena.next = data(keep);
+        arena.end = arena.next + chunkSize;
+    }else{
+        arena.next = arena.end = nullptr;
+    }
+}
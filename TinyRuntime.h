@@ -0,0 +1,35 @@
+//
+// Runtime support for compiled programs: the heap behind new and delete.
+//
+
+#ifndef TINYCOMPILER_TINYRUNTIME_H
+#define TINYCOMPILER_TINYRUNTIME_H
+
+#include <stdint.h>
+
+// Memory comes from a per-thread bump arena: an allocation is a pointer
+// increment in the current chunk, and everything is given back at once by
+// tinyrt_release. Requests bigger than a quarter chunk get a chunk of their
+// own. The compiler links this in so JIT-run programs find the symbols;
+// `make libtinyrt.a` builds it for programs linked from object files.
+//
+// Programs call tinyrt_release themselves after declaring it:
+//   extern void tinyrt_release()
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// size bytes aligned to 16, uninitialised. Aborts when out of memory.
+void* tinyrt_alloc(uint64_t size);
+
+// Reclaimed at once when it is the latest allocation, otherwise at the next tinyrt_release
+void tinyrt_free(void* pointer);
+
+// Drop every allocation made on this thread, keeping one chunk for reuse
+void tinyrt_release();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //TINYCOMPILER_TINYRUNTIME_H
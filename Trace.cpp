@@ -0,0 +1,105 @@
+//
+// Levelled, per-subsystem diagnostic tracing that release builds compile out.
+//
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#include "Trace.h"
+
+std::atomic<int> Trace::_levels[Trace::SubsystemCount];
+
+static const size_t flushThreshold = 64 * 1024;
+
+static std::mutex sinkMutex;
+
+// Per-thread buffer, written out when it fills up and when its thread exits
+struct TraceBuffer{
+    std::string text;
+
+    void flush(){
+        if( text.empty() )
+            return;
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        fwrite(text.data(), 1, text.size(), stderr);
+        text.clear();
+    }
+
+    ~TraceBuffer(){
+        flush();
+    }
+};
+
+static thread_local TraceBuffer buffer;
+
+const char* Trace::name(Subsystem subsystem) {
+    switch( subsystem ){
+        case Lexer: return "lexer";
+        case Parser: return "parser";
+        case CodeGen: return "codegen";
+        case Symbols: return "symbols";
+        default: return "?";
+    }
+}
+
+bool Trace::configure(const std::string &spec) {
+    size_t start = 0;
+    while( start < spec.size() ){
+        size_t end = spec.find(',', start);
+        if( end == std::string::npos )
+            end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        start = end + 1;
+        if( item.empty() )
+            continue;
+
+        int level = 1;
+        size_t colon = item.find(':');
+        if( colon != std::string::npos ){
+            level = atoi(item.c_str() + colon + 1);
+            item = item.substr(0, colon);
+        }
+
+        bool found = false;
+        for(int i=0; i<SubsystemCount; i++){
+            if( item == "all" || item == name((Subsystem)i) ){
+                _levels[i] = level;
+                found = true;
+            }
+        }
+        if( !found ){
+            fprintf(stderr, "Unknown trace subsystem %s\n", item.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void Trace::write(Subsystem subsystem, const std::string &message) {
+    buffer.text += '[';
+    buffer.text += name(subsystem);
+    buffer.text += "] ";
+    buffer.text += message;
+    buffer.text += '\n';
+    if( buffer.text.size() >= flushThreshold )
+        buffer.flush();
+}
+
+void Trace::printf(const char *format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if( length > 0 )
+        buffer.text.append(text, std::min((size_t)length, sizeof(text) - 1));
+    if( buffer.text.size() >= flushThreshold )
+        buffer.flush();
+}
+
+void Trace::flush() {
+    buffer.flush();
+}
@@ -0,0 +1,80 @@
+//
+// Levelled, per-subsystem diagnostic tracing that release builds compile out.
+//
+
+#ifndef TINYCOMPILER_TRACE_H
+#define TINYCOMPILER_TRACE_H
+
+#include <atomic>
+#include <sstream>
+#include <string>
+
+// Level 1 traces phases and tokens, 2 every AST node and symbol update, and
+// 3 adds dumps such as the whole symbol table after each declaration.
+// Everything is off until configure() is given a spec, and building with
+// TINYCOMPILER_NO_TRACE (make RELEASE=1) turns every TRACE into nothing at
+// all. NDEBUG is not used for this since llvm-config may already pass it.
+class Trace{
+public:
+    enum Subsystem{
+        Lexer,
+        Parser,
+        CodeGen,
+        Symbols,
+        SubsystemCount
+    };
+
+private:
+    static std::atomic<int> _levels[SubsystemCount];
+
+public:
+    static bool enabled(Subsystem subsystem, int level){
+        return _levels[subsystem].load(std::memory_order_relaxed) >= level;
+    }
+
+    // "lexer,codegen:2" or "all:3"; a subsystem without a level gets 1.
+    // Returns false on an unknown subsystem name.
+    static bool configure(const std::string& spec);
+
+    // Lines are collected in a per-thread buffer and written to stderr in
+    // large chunks instead of being flushed one by one
+    static void write(Subsystem subsystem, const std::string& message);
+
+    // Raw printf-style text for bison's yydebug output, which builds lines piecewise
+    static void printf(const char* format, ...);
+    static void flush();
+
+    static const char* name(Subsystem subsystem);
+};
+
+// Builds one trace line and hands it to the sink when it goes out of scope
+class TraceLine{
+private:
+    Trace::Subsystem _subsystem;
+    std::ostringstream _stream;
+
+public:
+    explicit TraceLine(Trace::Subsystem subsystem): _subsystem(subsystem){}
+
+    ~TraceLine(){
+        Trace::write(_subsystem, _stream.str());
+    }
+
+    std::ostream& stream(){
+        return _stream;
+    }
+};
+
+#ifdef TINYCOMPILER_NO_TRACE
+#define TRACE(subsystem, level, message) do{ }while(0)
+#else
+#define TRACE(subsystem, level, message) \
+    do{ \
+        if( Trace::enabled(Trace::subsystem, level) ){ \
+            TraceLine traceLine(Trace::subsystem); \
+            traceLine.stream() << message; \
+        } \
+    }while(0)
+#endif
+
+#endif //TINYCOMPILER_TRACE_H
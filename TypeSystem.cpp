@@ -63,6 +63,7 @@ TypeSystem::TypeSystem(LLVMContext &context): llvmContext(context){
     addCast(intTy, floatTy, llvm::CastInst::SIToFP);
     addCast(intTy, doubleTy, llvm::CastInst::SIToFP);
     addCast(boolTy, doubleTy, llvm::CastInst::SIToFP);
+    addCast(boolTy, intTy, llvm::CastInst::ZExt);        // conditions stored to int are 0 or 1
     addCast(floatTy, doubleTy, llvm::CastInst::FPExt);
     addCast(floatTy, intTy, llvm::CastInst::FPToSI);
     addCast(doubleTy, intTy, llvm::CastInst::FPToSI);
@@ -84,9 +85,11 @@ void TypeSystem::addStructType(string name, llvm::StructType *type) {
 Type *TypeSystem::getVarType(const NIdentifier& type) {
     assert(type.isType);
     if( type.isArray ){     // array type when allocation, pointer type when pass parameters
-//        return ArrayType::get(getVarType(type.name), type.arraySize->value);
+        // decays like C: int a[2][3] is passed as a [3 x i32]*
+        return PointerType::get(getArrayType(type)->getArrayElementType(), 0);
+    }
+    if( type.isReference || type.isPointer ){     // ref parameters hold the address of the caller's struct
         return PointerType::get(getVarType(type.name), 0);
-//        PointerType::getUnqual(ArrayType::get(getVarType(type.name), type.arraySize->value));
     }
 
     return getVarType(type.name);
@@ -152,6 +155,17 @@ long TypeSystem::getStructMemberIndex(string structName, string memberName) {
     return 0;
 }
 
+Type *TypeSystem::getArrayType(const NIdentifier &type) {
+    assert(type.isArray && type.arraySize && !type.arraySize->empty());
+    Type* arrayType = getVarType(type.name);
+    for(auto it=type.arraySize->rbegin(); it!=type.arraySize->rend(); it++){
+        NInteger* size = dynamic_cast<NInteger*>(*it);
+        assert(size != nullptr);
+        arrayType = ArrayType::get(arrayType, size->value);
+    }
+    return arrayType;
+}
+
 Type *TypeSystem::getVarType(string typeStr) {
 
     if( typeStr.compare("int") == 0 ){
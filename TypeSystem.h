@@ -102,6 +102,9 @@ public:
     Type* getVarType(const NIdentifier& type) ;
     Type* getVarType(string typeStr) ;
 
+    // int a[2][3] -> [2 x [3 x i32]], what an array declaration allocates
+    Type* getArrayType(const NIdentifier& type) ;
+
     Value* getDefaultValue(string typeStr, LLVMContext &context) ;
 
     Value* cast(Value* value, Type* type, BasicBlock* block) ;
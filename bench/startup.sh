@@ -0,0 +1,44 @@
+#!/bin/sh
+# Wall-clock start-up cost of target initialisation on a tiny input.
+#
+# The default run registers only the native backend. The baseline sets
+# TINYCOMPILER_ALL_TARGETS so every backend is registered up front, which is
+# what each invocation used to pay for, but still compiles for the host, so
+# both runs generate the same code and the difference is the initialisation.
+# The object cache is switched off, a hit would skip the work being measured.
+#
+# Usage: bench/startup.sh [runs] [input]
+
+RUNS=${1:-50}
+INPUT=${2:-tests/testBasic.input}
+COMPILER=./compiler
+
+unset TINYCOMPILER_CACHE_DIR TINYCOMPILER_ALL_TARGETS
+
+if [ ! -x "$COMPILER" ]; then
+    echo "build the compiler first (make)" >&2
+    exit 1
+fi
+
+now_ms(){
+    date +%s%N | cut -c1-13
+}
+
+measure(){
+    start=$(now_ms)
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        "$@" > /dev/null 2>&1
+        i=$((i + 1))
+    done
+    end=$(now_ms)
+    echo $(( (end - start) / RUNS ))
+}
+
+native=$(measure $COMPILER -o /tmp/bench_native.o "$INPUT")
+all=$(measure env TINYCOMPILER_ALL_TARGETS=1 $COMPILER -o /tmp/bench_all.o "$INPUT")
+
+echo "input:               $INPUT ($RUNS runs)"
+echo "native target only:  ${native} ms/run"
+echo "all targets:         ${all} ms/run"
+rm -f /tmp/bench_native.o /tmp/bench_all.o
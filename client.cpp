@@ -0,0 +1,142 @@
+//
+// tinyc: thin front end that sends sources to a running `compiler --daemon`
+// and writes back the object file, without loading LLVM at all.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Protocol.h"
+
+static bool readFile(const std::string& path, std::string& text){
+    std::ifstream file(path, std::ios::binary);
+    if( !file.is_open() ){
+        fprintf(stderr, "Can't open %s\n", path.c_str());
+        return false;
+    }
+    std::ostringstream content;
+    content << file.rdbuf();
+    text = content.str();
+    return true;
+}
+
+static bool readInputList(const std::string& path, std::vector<std::string>& inputs){
+    std::string text;
+    if( !readFile(path, text) )
+        return false;
+    std::istringstream list(text);
+    std::string line;
+    while( std::getline(list, line) ){
+        if( !line.empty() && line.back() == '\r' )
+            line.pop_back();
+        if( !line.empty() )
+            inputs.push_back(line);
+    }
+    return true;
+}
+
+static int connectTo(const std::string& path){
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if( path.size() >= sizeof(address.sun_path) )
+        return -1;
+    strcpy(address.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( fd < 0 )
+        return -1;
+    if( connect(fd, (sockaddr*)&address, sizeof(address)) < 0 ){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    std::string output = "output.o";
+    std::string socketPath;             // defaultSocketPath() unless --socket
+    std::string forwarded;              // NUL separated options for the daemon
+    std::vector<std::string> inputs;
+
+    for(int i=1; i<argc; i++){
+        std::string arg = argv[i];
+        const char* value = optionValueName(arg);
+        if( value && i + 1 >= argc ){
+            fprintf(stderr, "%s expects %s\n", arg.c_str(), value);
+            return 2;
+        }
+
+        if( arg == "-o" ){
+            output = argv[++i];
+        }else if( arg == "--socket" ){
+            socketPath = argv[++i];
+        }else if( arg[0] == '@' ){
+            if( !readInputList(arg.substr(1), inputs) )
+                return 2;
+        }else if( arg[0] == '-' && arg.size() > 1 ){
+            forwarded += forwarded.empty() ? arg : std::string(1, '\0') + arg;
+            if( value ){
+                forwarded += std::string(1, '\0') + argv[++i];
+            }
+        }else{
+            inputs.push_back(arg);
+        }
+    }
+    if( inputs.empty() ){
+        fprintf(stderr, "usage: tinyc [--socket PATH] [-o output.o] [compiler options] inputs...\n");
+        return 2;
+    }
+
+    if( socketPath.empty() ){
+        socketPath = defaultSocketPath();
+        if( socketPath.empty() )
+            return 1;
+    }
+
+    int fd = connectTo(socketPath);
+    if( fd < 0 ){
+        fprintf(stderr, "No daemon listening on %s, start one with `compiler --daemon`\n", socketPath.c_str());
+        return 1;
+    }
+
+    bool sent = writeFrame(fd, TINYCOMPILER_PROTOCOL_MAGIC) && writeFrame(fd, forwarded)
+                && writeFrame(fd, std::to_string(inputs.size()));
+    for(auto& input: inputs){
+        std::string text;
+        if( !readFile(input, text) ){
+            close(fd);
+            return 1;
+        }
+        sent = sent && writeFrame(fd, input) && writeFrame(fd, text);
+    }
+
+    std::string status, message, object;
+    bool received = sent && readFrame(fd, status) && readFrame(fd, message) && readFrame(fd, object);
+    close(fd);
+    if( !received ){
+        fprintf(stderr, "Lost the connection to the daemon on %s\n", socketPath.c_str());
+        return 1;
+    }
+
+    std::cerr << message;
+    if( status != "0" )
+        return 1;
+
+    std::ofstream objectFile(output, std::ios::binary);
+    if( !objectFile.is_open() ){
+        fprintf(stderr, "Can't open %s\n", output.c_str());
+        return 1;
+    }
+    objectFile.write(object.data(), object.size());
+    std::cout << "Object code wrote to " << output << std::endl;
+    return 0;
+}
@@ -1,13 +1,41 @@
+%code requires {
+	#ifndef YY_TYPEDEF_YY_SCANNER_T
+	#define YY_TYPEDEF_YY_SCANNER_T
+	typedef void* yyscan_t;
+	#endif
+	class ParseContext;
+}
 %{
 	#include "ASTNodes.h"
+	#include "ParseContext.h"
+	#include "Trace.h"
 	#include <stdio.h>
-	NBlock* programBlock;
-	extern int yylex();
-	void yyerror(const char* s)
+
+	// bison's own state machine trace (parser level 2) goes to the trace sink
+	#define YYFPRINTF(file, ...) Trace::printf(__VA_ARGS__)
+%}
+%code {
+	extern int yylex(YYSTYPE* lvalp, yyscan_t scanner);
+	void yyerror(yyscan_t scanner, ParseContext& context, const char* s)
 	{
+		context.errors++;
 		printf("Error: %s\n", s);
 	}
-%}
+
+	static void setLoopHint(yyscan_t scanner, ParseContext& context, LoopHints& hints, Symbol name, bool hasValue, uint64_t value)
+	{
+		if( !hints.set(name.str(), hasValue, value) ){
+			std::string message = "unknown loop hint or bad value: @" + name.str();
+			yyerror(scanner, context, message.c_str());
+		}
+	}
+}
+
+%define api.pure full
+%define parse.trace
+%lex-param { yyscan_t scanner }
+%parse-param { yyscan_t scanner } { ParseContext& context }
+
 %union
 {
 	NBlock* block;
@@ -16,65 +44,85 @@
 	NIdentifier* ident;
 	NVariableDeclaration* var_decl;
 	NArrayIndex* index;
-	std::vector<shared_ptr<NVariableDeclaration>>* varvec;
-	std::vector<shared_ptr<NExpression>>* exprvec;
-	std::string* string;
+	LoopHints* hints;
+	VariableList* varvec;
+	ExpressionList* exprvec;
+	SymbolID symbol;
+	uint64_t integer;
+	double number;
 	int token;
 }
 
-%token <string> TIDENTIFIER TINTEGER TDOUBLE TYINT TYDOUBLE TYFLOAT TYCHAR TYBOOL TYVOID TYSTRING TEXTERN TLITERAL
+%token <symbol> TIDENTIFIER TYINT TYDOUBLE TYFLOAT TYCHAR TYBOOL TYVOID TYSTRING TLITERAL
+%token <integer> TINTEGER
+%token <number> TDOUBLE
+%token <token> TEXTERN TREF TCONST TNEW TDELETE
 %token <token> TCEQ TCNE TCLT TCLE TCGT TCGE TEQUAL
-%token <token> TLPAREN TRPAREN TLBRACE TRBRACE TCOMMA TDOT TSEMICOLON TLBRACKET TRBRACKET TQUOTATION
-%token <token> TPLUS TMINUS TMUL TDIV TAND TOR TXOR TMOD TNEG TNOT TSHIFTL TSHIFTR
-%token <token> TIF TELSE TFOR TWHILE TRETURN TSTRUCT
+%token <token> TLPAREN TRPAREN TLBRACE TRBRACE TCOMMA TDOT TSEMICOLON TLBRACKET TRBRACKET TQUOTATION TAT
+%token <token> TPLUS TMINUS TMUL TDIV TAND TOR TXOR TMOD TNEG TNOT TSHIFTL TSHIFTR TLAND TLOR
+%token <token> TIF TELSE TFOR TWHILE TRETURN TSTRUCT TBREAK TCONTINUE
 
 %type <index> array_index
-%type <ident> ident primary_typename array_typename struct_typename typename
+%type <ident> ident primary_typename array_typename struct_typename pointer_typename typename new_typename
 %type <expr> numeric expr assign
 %type <varvec> func_decl_args struct_members
 %type <exprvec> call_args
 %type <block> program stmts block
 %type <stmt> stmt var_decl func_decl struct_decl if_stmt for_stmt while_stmt
 %type <token> comparison
+%type <hints> loop_hints
+%type <var_decl> param_decl
 
+%left TLOR
+%left TLAND
+%left TCEQ TCNE TCLT TCLE TCGT TCGE TAND TOR TXOR TSHIFTL TSHIFTR
 %left TPLUS TMINUS
 %left TMUL TDIV TMOD
+%right TNOT
 
 %start program
 
 %%
-program : stmts { programBlock = $1; }
+program : stmts { context.appendProgram($1); }
 				;
-stmts : stmt { $$ = new NBlock(); $$->statements->push_back(shared_ptr<NStatement>($1)); }
-			| stmts stmt { $1->statements->push_back(shared_ptr<NStatement>($2)); }
+stmts : stmt { $$ = context.arena.make<NBlock>(context.arena.makeList<StatementList>()); $$->statements->push_back($1); }
+			| stmts stmt { $1->statements->push_back($2); }
 			;
 stmt : var_decl | func_decl | struct_decl
-		 | expr { $$ = new NExpressionStatement(shared_ptr<NExpression>($1)); }
-		 | TRETURN expr { $$ = new NReturnStatement(shared_ptr<NExpression>($2)); }
+		 | expr { $$ = context.arena.make<NExpressionStatement>($1); }
+		 | TRETURN expr { $$ = context.arena.make<NReturnStatement>($2); }
+		 | TDELETE ident { $$ = context.arena.make<NDeleteStatement>($2); }
+		 | TDELETE ident TDOT ident { $$ = context.arena.make<NDeleteStatement>(context.arena.make<NStructMember>($2, $4)); }
+		 | TDELETE array_index { $$ = context.arena.make<NDeleteStatement>($2); }
+		 | TBREAK { $$ = context.arena.make<NBreakStatement>(); }
+		 | TCONTINUE { $$ = context.arena.make<NContinueStatement>(); }
 		 | if_stmt
 		 | for_stmt
 		 | while_stmt
+		 | loop_hints for_stmt { static_cast<NForStatement*>($2)->hints = *$1; $$ = $2; }
+		 | loop_hints while_stmt { static_cast<NForStatement*>($2)->hints = *$1; $$ = $2; }
 		 ;
 
 block : TLBRACE stmts TRBRACE { $$ = $2; }
-			| TLBRACE TRBRACE { $$ = new NBlock(); }
+			| TLBRACE TRBRACE { $$ = context.arena.make<NBlock>(context.arena.makeList<StatementList>()); }
 			;
 
-primary_typename : TYINT { $$ = new NIdentifier(*$1); $$->isType = true;  delete $1; }
-					| TYDOUBLE { $$ = new NIdentifier(*$1); $$->isType = true; delete $1; }
-					| TYFLOAT { $$ = new NIdentifier(*$1); $$->isType = true; delete $1; }
-					| TYCHAR { $$ = new NIdentifier(*$1); $$->isType = true; delete $1; }
-					| TYBOOL { $$ = new NIdentifier(*$1); $$->isType = true; delete $1; }
-					| TYVOID { $$ = new NIdentifier(*$1); $$->isType = true; delete $1; }
-					| TYSTRING { $$ = new NIdentifier(*$1); $$->isType = true; delete $1; }
+primary_typename : TYINT { $$ = context.arena.make<NIdentifier>(context.symbols.get($1)); $$->isType = true; }
+					| TYDOUBLE { $$ = context.arena.make<NIdentifier>(context.symbols.get($1)); $$->isType = true; }
+					| TYFLOAT { $$ = context.arena.make<NIdentifier>(context.symbols.get($1)); $$->isType = true; }
+					| TYCHAR { $$ = context.arena.make<NIdentifier>(context.symbols.get($1)); $$->isType = true; }
+					| TYBOOL { $$ = context.arena.make<NIdentifier>(context.symbols.get($1)); $$->isType = true; }
+					| TYVOID { $$ = context.arena.make<NIdentifier>(context.symbols.get($1)); $$->isType = true; }
+					| TYSTRING { $$ = context.arena.make<NIdentifier>(context.symbols.get($1)); $$->isType = true; }
 
 array_typename : primary_typename TLBRACKET TINTEGER TRBRACKET { 
 					$1->isArray = true; 
-					$1->arraySize->push_back(make_shared<NInteger>(atol($3->c_str()))); 
+					$1->arraySize = context.arena.makeList<ExpressionList>();
+					$1->arraySize->push_back(context.arena.make<NInteger>($3)); 
 					$$ = $1; 
 				}
 				| array_typename TLBRACKET TINTEGER TRBRACKET {
-					$1->arraySize->push_back(make_shared<NInteger>(atol($3->c_str())));
+					$1->arraySize->push_back(context.arena.make<NInteger>($3));
 					$$ = $1;
 				}
 
@@ -83,88 +131,128 @@ struct_typename : TSTRUCT ident {
 				$$ = $2;
 			}
 
+pointer_typename : primary_typename TMUL {
+					$1->isPointer = true;
+					$$ = $1;
+				}
+				| struct_typename TMUL {
+					$1->isPointer = true;
+					$$ = $1;
+				}
+
+new_typename : primary_typename { $$ = $1; }
+			| struct_typename { $$ = $1; }
+
 typename : primary_typename { $$ = $1; }
 			| array_typename { $$ = $1; }
 			| struct_typename { $$ = $1; }
+			| pointer_typename { $$ = $1; }
 
-var_decl : typename ident { $$ = new NVariableDeclaration(shared_ptr<NIdentifier>($1), shared_ptr<NIdentifier>($2), nullptr); }
-				 | typename ident TEQUAL expr { $$ = new NVariableDeclaration(shared_ptr<NIdentifier>($1), shared_ptr<NIdentifier>($2), shared_ptr<NExpression>($4)); }
+var_decl : typename ident { $$ = context.arena.make<NVariableDeclaration>($1, $2, nullptr); }
+				 | typename ident TEQUAL expr { $$ = context.arena.make<NVariableDeclaration>($1, $2, $4); }
 				 | typename ident TEQUAL TLBRACKET call_args TRBRACKET {
-					 $$ = new NArrayInitialization(make_shared<NVariableDeclaration>(shared_ptr<NIdentifier>($1), shared_ptr<NIdentifier>($2), nullptr), shared_ptr<ExpressionList>($5));
+					 $$ = context.arena.make<NArrayInitialization>(context.arena.make<NVariableDeclaration>($1, $2, nullptr), $5);
 				 }
 				 ;
 
 func_decl : typename ident TLPAREN func_decl_args TRPAREN block
-				{ $$ = new NFunctionDeclaration(shared_ptr<NIdentifier>($1), shared_ptr<NIdentifier>($2), shared_ptr<VariableList>($4), shared_ptr<NBlock>($6));  }
-			| TEXTERN typename ident TLPAREN func_decl_args TRPAREN { $$ = new NFunctionDeclaration(shared_ptr<NIdentifier>($2), shared_ptr<NIdentifier>($3), shared_ptr<VariableList>($5), nullptr, true); }
+				{ $$ = context.arena.make<NFunctionDeclaration>($1, $2, $4, $6);  }
+			| TEXTERN typename ident TLPAREN func_decl_args TRPAREN { $$ = context.arena.make<NFunctionDeclaration>($2, $3, $5, nullptr, true); }
 
-func_decl_args : /* blank */ { $$ = new VariableList(); }
-							 | var_decl { $$ = new VariableList(); $$->push_back(shared_ptr<NVariableDeclaration>($<var_decl>1)); }
-							 | func_decl_args TCOMMA var_decl { $1->push_back(shared_ptr<NVariableDeclaration>($<var_decl>3)); }
+func_decl_args : /* blank */ { $$ = context.arena.makeList<VariableList>(); }
+							 | param_decl { $$ = context.arena.makeList<VariableList>(); $$->push_back($1); }
+							 | func_decl_args TCOMMA param_decl { $1->push_back($3); }
 							 ;
 
-ident : TIDENTIFIER { $$ = new NIdentifier(*$1); delete $1; }
+param_decl : var_decl { $$ = $<var_decl>1; }
+			| TREF struct_typename ident {
+				$2->isReference = true;
+				$$ = context.arena.make<NVariableDeclaration>($2, $3, nullptr);
+			}
+			| TCONST TREF struct_typename ident {
+				$3->isReference = true;
+				$3->isConst = true;
+				$$ = context.arena.make<NVariableDeclaration>($3, $4, nullptr);
+			}
+			;
+
+ident : TIDENTIFIER { $$ = context.arena.make<NIdentifier>(context.symbols.get($1)); }
 			;
 
-numeric : TINTEGER { $$ = new NInteger(atol($1->c_str())); }
-				| TDOUBLE { $$ = new NDouble(atof($1->c_str())); }
+numeric : TINTEGER { $$ = context.arena.make<NInteger>($1); }
+				| TDOUBLE { $$ = context.arena.make<NDouble>($1); }
 				;
 expr : 	assign { $$ = $1; }
-		 | ident TLPAREN call_args TRPAREN { $$ = new NMethodCall(shared_ptr<NIdentifier>($1), shared_ptr<ExpressionList>($3)); }
+		 | ident TLPAREN call_args TRPAREN { $$ = context.arena.make<NMethodCall>($1, $3); }
 		 | ident { $<ident>$ = $1; }
-		 | ident TDOT ident { $$ = new NStructMember(shared_ptr<NIdentifier>($1), shared_ptr<NIdentifier>($3)); }
+		 | ident TDOT ident { $$ = context.arena.make<NStructMember>($1, $3); }
 		 | numeric
-		 | expr comparison expr { $$ = new NBinaryOperator(shared_ptr<NExpression>($1), $2, shared_ptr<NExpression>($3)); }
-		 | expr TMOD expr { $$ = new NBinaryOperator(shared_ptr<NExpression>($1), $2, shared_ptr<NExpression>($3)); }
-		 | expr TMUL expr { $$ = new NBinaryOperator(shared_ptr<NExpression>($1), $2, shared_ptr<NExpression>($3)); }
-		 | expr TDIV expr { $$ = new NBinaryOperator(shared_ptr<NExpression>($1), $2, shared_ptr<NExpression>($3)); }
-		 | expr TPLUS expr { $$ = new NBinaryOperator(shared_ptr<NExpression>($1), $2, shared_ptr<NExpression>($3)); }
-		 | expr TMINUS expr { $$ = new NBinaryOperator(shared_ptr<NExpression>($1), $2, shared_ptr<NExpression>($3)); }
+		 | expr comparison expr %prec TCEQ { $$ = context.arena.make<NBinaryOperator>($1, $2, $3); }
+		 | expr TLAND expr { $$ = context.arena.make<NBinaryOperator>($1, $2, $3); }
+		 | expr TLOR expr { $$ = context.arena.make<NBinaryOperator>($1, $2, $3); }
+		 | TNOT expr { $$ = context.arena.make<NUnaryOperator>($1, $2); }
+		 | expr TMOD expr { $$ = context.arena.make<NBinaryOperator>($1, $2, $3); }
+		 | expr TMUL expr { $$ = context.arena.make<NBinaryOperator>($1, $2, $3); }
+		 | expr TDIV expr { $$ = context.arena.make<NBinaryOperator>($1, $2, $3); }
+		 | expr TPLUS expr { $$ = context.arena.make<NBinaryOperator>($1, $2, $3); }
+		 | expr TMINUS expr { $$ = context.arena.make<NBinaryOperator>($1, $2, $3); }
 		 | TLPAREN expr TRPAREN { $$ = $2; }
 		 | TMINUS expr { $$ = nullptr; /* TODO */ }
 		 | array_index { $$ = $1; }
-		 | TLITERAL { $$ = new NLiteral(*$1); delete $1; }
+		 | TNEW new_typename { $$ = context.arena.make<NNewExpression>($2, nullptr); }
+		 | TNEW new_typename TLBRACKET expr TRBRACKET { $$ = context.arena.make<NNewExpression>($2, $4); }
+		 | TLITERAL { $$ = context.arena.make<NLiteral>(context.symbols.get($1)); }
 		 ;
 
 array_index : ident TLBRACKET expr TRBRACKET 
-				{ $$ = new NArrayIndex(shared_ptr<NIdentifier>($1), shared_ptr<NExpression>($3)); }
+				{
+					auto indices = context.arena.makeList<ExpressionList>();
+					indices->push_back($3);
+					$$ = context.arena.make<NArrayIndex>($1, indices);
+				}
 				| array_index TLBRACKET expr TRBRACKET 
 					{ 	
-						$1->expressions->push_back(shared_ptr<NExpression>($3));
+						$1->expressions->push_back($3);
 						$$ = $1;
 					}
-assign : ident TEQUAL expr { $$ = new NAssignment(shared_ptr<NIdentifier>($1), shared_ptr<NExpression>($3)); }
+assign : ident TEQUAL expr { $$ = context.arena.make<NAssignment>($1, $3); }
 			| array_index TEQUAL expr {
-				$$ = new NArrayAssignment(shared_ptr<NArrayIndex>($1), shared_ptr<NExpression>($3));
+				$$ = context.arena.make<NArrayAssignment>($1, $3);
 			}
 			| ident TDOT ident TEQUAL expr {
-				auto member = make_shared<NStructMember>(shared_ptr<NIdentifier>($1), shared_ptr<NIdentifier>($3)); 
-				$$ = new NStructAssignment(member, shared_ptr<NExpression>($5)); 
+				auto member = context.arena.make<NStructMember>($1, $3); 
+				$$ = context.arena.make<NStructAssignment>(member, $5); 
 			}
 			;
 
-call_args : /* blank */ { $$ = new ExpressionList(); }
-					| expr { $$ = new ExpressionList(); $$->push_back(shared_ptr<NExpression>($1)); }
-					| call_args TCOMMA expr { $1->push_back(shared_ptr<NExpression>($3)); }
+call_args : /* blank */ { $$ = context.arena.makeList<ExpressionList>(); }
+					| expr { $$ = context.arena.makeList<ExpressionList>(); $$->push_back($1); }
+					| call_args TCOMMA expr { $1->push_back($3); }
 comparison : TCEQ | TCNE | TCLT | TCLE | TCGT | TCGE
 				 | TAND | TOR | TXOR | TSHIFTL | TSHIFTR
 					 ;
-if_stmt : TIF expr block { $$ = new NIfStatement(shared_ptr<NExpression>($2), shared_ptr<NBlock>($3)); }
-		| TIF expr block TELSE block { $$ = new NIfStatement(shared_ptr<NExpression>($2), shared_ptr<NBlock>($3), shared_ptr<NBlock>($5)); }
+if_stmt : TIF expr block { $$ = context.arena.make<NIfStatement>($2, $3); }
+		| TIF expr block TELSE block { $$ = context.arena.make<NIfStatement>($2, $3, $5); }
 		| TIF expr block TELSE if_stmt { 
-			auto blk = new NBlock(); 
-			blk->statements->push_back(shared_ptr<NStatement>($5)); 
-			$$ = new NIfStatement(shared_ptr<NExpression>($2), shared_ptr<NBlock>($3), shared_ptr<NBlock>(blk)); 
+			auto blk = context.arena.make<NBlock>(context.arena.makeList<StatementList>()); 
+			blk->statements->push_back($5); 
+			$$ = context.arena.make<NIfStatement>($2, $3, blk); 
 		}
 
-for_stmt : TFOR TLPAREN expr TSEMICOLON expr TSEMICOLON expr TRPAREN block { $$ = new NForStatement(shared_ptr<NBlock>($9), shared_ptr<NExpression>($3), shared_ptr<NExpression>($5), shared_ptr<NExpression>($7)); }
+for_stmt : TFOR TLPAREN expr TSEMICOLON expr TSEMICOLON expr TRPAREN block { $$ = context.arena.make<NForStatement>($9, $3, $5, $7); }
 		
-while_stmt : TWHILE TLPAREN expr TRPAREN block { $$ = new NForStatement(shared_ptr<NBlock>($5), nullptr, shared_ptr<NExpression>($3), nullptr); }
+while_stmt : TWHILE TLPAREN expr TRPAREN block { $$ = context.arena.make<NForStatement>($5, nullptr, $3, nullptr); }
+
+loop_hints : TAT ident { $$ = context.arena.make<LoopHints>(); setLoopHint(scanner, context, *$$, $2->name, false, 0); }
+			| TAT ident TLPAREN TINTEGER TRPAREN { $$ = context.arena.make<LoopHints>(); setLoopHint(scanner, context, *$$, $2->name, true, $4); }
+			| loop_hints TAT ident { setLoopHint(scanner, context, *$1, $3->name, false, 0); }
+			| loop_hints TAT ident TLPAREN TINTEGER TRPAREN { setLoopHint(scanner, context, *$1, $3->name, true, $5); }
+			;
 
-struct_decl : TSTRUCT ident TLBRACE struct_members TRBRACE {$$ = new NStructDeclaration(shared_ptr<NIdentifier>($2), shared_ptr<VariableList>($4)); }
+struct_decl : TSTRUCT ident TLBRACE struct_members TRBRACE {$$ = context.arena.make<NStructDeclaration>($2, $4); }
 
-struct_members : /* blank */ { $$ = new VariableList(); }
-				| var_decl { $$ = new VariableList(); $$->push_back(shared_ptr<NVariableDeclaration>($<var_decl>1)); }
-				| struct_members var_decl { $1->push_back(shared_ptr<NVariableDeclaration>($<var_decl>2)); }
+struct_members : /* blank */ { $$ = context.arena.makeList<VariableList>(); }
+				| var_decl { $$ = context.arena.makeList<VariableList>(); $$->push_back($<var_decl>1); }
+				| struct_members var_decl { $1->push_back($<var_decl>2); }
 
 %%
\ No newline at end of file
@@ -1,38 +1,138 @@
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 #include "ASTNodes.h"
+#include "ASTSerializer.h"
+#include "ASTSimplifier.h"
 #include "CodeGen.h"
+#include "CompileCache.h"
+#include "Daemon.h"
+#include "Driver.h"
+#include "JsonWriter.h"
 #include "ObjGen.h"
+#include "ParseContext.h"
+#include "Repl.h"
+#include "SourceBuffer.h"
+#include "TimeTrace.h"
+#include "TinyJIT.h"
+#include "Trace.h"
 
-extern shared_ptr<NBlock> programBlock;
-extern int yyparse();
-// extern void yyparse_init(const char* filename);
-// extern void yyparse_cleanup();
 //
 //void createCoreFunctions(CodeGenContext& context);
 
-int main(int argc, char **argv) {
-    yyparse();
+// Parse every mapped input as if they were concatenated, or stdin when there are none.
+static bool parseInputs(ParseContext& parseContext, const std::vector<std::unique_ptr<SourceBuffer>>& sources){
+    if( sources.empty() ){
+        return parseContext.parse(stdin);
+    }
+
+    for(auto& source: sources){
+        if( !parseContext.parse(*source) ){
+            fprintf(stderr, "Failed to parse %s\n", source->path().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compileProgram(const DriverOptions& options){
+    TraceScope timeScope("Compile", options.output);
+
+    std::vector<std::unique_ptr<SourceBuffer>> sources;
+    if( !openSources(options.inputs, sources) ){
+        return 1;
+    }
+
+    // stdin can't be hashed up front, so it always takes the slow path; --run has no object to cache,
+    // and the AST dumps need the program parsed anyway
+    bool dumpsAST = options.astDump || !options.astJson.empty() || !options.emitAST.empty();
+    std::string cacheDir = sources.empty() || options.run || dumpsAST ? "" : CompileCache::directoryFor(options);
+    std::string cacheKey;
+    if( !cacheDir.empty() ){
+        cacheKey = CompileCache::key(sources, options);
+        if( CompileCache(cacheDir).fetch(cacheKey, options.output) ){
+            cout << "Object code copied from cache to " << options.output << endl;
+            return 0;
+        }
+    }
+
+    ParseContext parseContext;
+    if( !parseInputs(parseContext, sources) ){
+        return 1;
+    }
+    NBlock* programBlock = parseContext.programBlock;
 
     // std::cout << programBlock << std::endl;
-    programBlock->print("--");
-    auto root = programBlock->jsonGen();
+    if( options.astDump ){
+        TraceScope printScope("Print AST");
+        programBlock->print("--");
+    }
+    if( !options.emitAST.empty() && !ASTWriter().write(*programBlock, options.emitAST) ){
+        return 1;
+    }
+    if( !options.astJson.empty() ){
+        TraceScope jsonScope("JSON AST");
+        JsonWriter writer;
+        if( writer.open(options.astJson) ){
+            programBlock->jsonGen(writer);
+            if( writer.close() )
+                cout << "json write to " << options.astJson << endl;
+            else
+                fprintf(stderr, "Failed to write %s\n", options.astJson.c_str());
+        }
+    }
 
-//    cout << root;
+    if( options.fold ){
+        ASTSimplifier(parseContext.arena).run(*programBlock);
+    }
 
-//    cout << root << endl;
     CodeGenContext context;
+    context.targetCPU = options.cpu;
+    context.targetFeatures = options.features;
 //    createCoreFunctions(context);
     context.generateCode(*programBlock);
-    ObjGen(context);
 
-    string jsonFile = "visualization/A_tree.json";
-    std::ofstream astJson(jsonFile);
-    if( astJson.is_open() ){
-        astJson << root;
-        astJson.close();
-        cout << "json write to " << jsonFile << endl;
+    int status = 0;
+    if( options.run ){
+        status = runModule(std::move(context.theModule), options.cpu, options.features, options.optLevel);
+    } else{
+        if( !ObjGen(context, options.output, options.cpu, options.features, options.optLevel, options.triple) )
+            return 1;
+        if( !cacheDir.empty() )
+            CompileCache(cacheDir).store(cacheKey, options.output);
+    }
+
+    return status;
+}
+
+int main(int argc, char **argv) {
+    DriverOptions options;
+    if( !parseDriverOptions(argc, argv, options) ){
+        return 2;
+    }
+    if( options.timeTrace ){
+        TimeTrace::enable();
+    }
+    // the environment variable is read first so --trace can refine it
+    const char* traceSpec = getenv("TINYCOMPILER_TRACE");
+    if( (traceSpec && !Trace::configure(traceSpec)) || !Trace::configure(options.trace) ){
+        return 2;
     }
 
-    return 0;
+    int status;
+    if( options.batch ){
+        status = compileBatch(options) == 0 ? 0 : 1;
+    } else if( options.daemon ){
+        status = runDaemon(options);
+    } else if( options.repl ){
+        status = Repl(options).run(std::cin);
+    } else{
+        status = compileProgram(options);
+    }
+
+    if( options.timeTrace && TimeTrace::write(timeTraceFileFor(options)) ){
+        std::cerr << "Time trace wrote to " << timeTraceFileFor(options) << endl;
+    }
+    Trace::flush();
+    return status;
 }
\ No newline at end of file
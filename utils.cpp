@@ -8,8 +8,6 @@
 
 using namespace std;
 
-extern int yyparse();
-extern NBlock* programBlock;
 //
 //
 //llvm::Function* createPrintfFunction(CodeGenContext& context)